@@ -0,0 +1,208 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
+#include "changejournal.h"
+#include "config.h"
+#include "responsepacket.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+
+// revisions are saved as used in blocks, a new run starts past the block
+// of the last one
+#define REVISION_BLOCK (1 << 20)
+#define REVISION_FILE  "revision.vnsi"
+
+cMutex cChangeJournal::m_JournalsMutex;
+std::unordered_map<uint64_t, std::unique_ptr<cChangeJournal>> cChangeJournal::m_Journals;
+cMutex cChangeJournal::m_RevisionMutex;
+uint32_t cChangeJournal::m_LastRevision = 0;
+uint32_t cChangeJournal::m_ReservedRevision = 0;
+
+static uint64_t HashBytes(const uint8_t *data, uint32_t length)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint32_t i = 0; i < length; i++)
+  {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+cChangeJournal &cChangeJournal::Get(eKind kind, uint32_t params)
+{
+  cMutexLock lock(&m_JournalsMutex);
+  std::unique_ptr<cChangeJournal> &journal = m_Journals[(uint64_t)kind << 32 | params];
+  if (!journal)
+    journal.reset(new cChangeJournal);
+  return *journal;
+}
+
+uint32_t cChangeJournal::NextRevision()
+{
+  cMutexLock lock(&m_RevisionMutex);
+
+  if (m_LastRevision + 1 >= m_ReservedRevision)
+  {
+    cString filename = cString::sprintf("%s/" REVISION_FILE, *VNSIServerConfig.ConfigDirectory);
+    if (!m_ReservedRevision)
+    {
+      // without the file, the time keeps apart runs that are not too busy
+      unsigned int saved = 0;
+      FILE *file = fopen(filename, "r");
+      if (!file || fscanf(file, "%u", &saved) != 1)
+        saved = time(NULL);
+      if (file)
+        fclose(file);
+      m_LastRevision = saved;
+      m_ReservedRevision = saved;
+    }
+
+    m_ReservedRevision += REVISION_BLOCK;
+    FILE *file = fopen(filename, "w");
+    if (file)
+    {
+      fprintf(file, "%u\n", m_ReservedRevision);
+      fclose(file);
+    }
+    else
+      ERRORLOG("cChangeJournal: can't write %s", *filename);
+  }
+
+  return ++m_LastRevision;
+}
+
+void cChangeJournal::Update()
+{
+  if (!m_Revision)
+  {
+    m_Revision = NextRevision();
+    m_Issued.push_back(m_Revision);
+  }
+
+  uint32_t revision = 0;
+  m_Generation++;
+
+  for (const sItem &item : m_List.items)
+  {
+    uint64_t hash = HashBytes(m_List.data.data() + item.offset, item.length);
+    auto it = m_Entries.find(item.uid);
+    if (it != m_Entries.end() && it->second.hash == hash)
+    {
+      it->second.generation = m_Generation;
+      continue;
+    }
+
+    if (!revision)
+      revision = NextRevision();
+    m_Entries[item.uid] = sEntry{hash, revision, m_Generation};
+  }
+
+  for (auto it = m_Entries.begin(); it != m_Entries.end();)
+  {
+    if (it->second.generation != m_Generation)
+    {
+      if (!revision)
+        revision = NextRevision();
+      m_Deleted.push_back(sDeleted{it->first, revision});
+      it = m_Entries.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  if (revision)
+  {
+    m_Revision = revision;
+    m_Issued.push_back(revision);
+  }
+
+  // clients that did not see the dropped deletes need the full list
+  while (m_Deleted.size() > MAX_DELETED)
+  {
+    uint32_t oldest = m_Deleted.front().revision;
+    m_Deleted.pop_front();
+    while (!m_Issued.empty() && m_Issued.front() < oldest)
+      m_Issued.pop_front();
+  }
+  while (m_Issued.size() > MAX_ISSUED)
+    m_Issued.pop_front();
+}
+
+void cChangeJournal::WriteChanges(uint32_t since, uint64_t source,
+                                  const std::function<void(sList &list)> &build, cResponsePacket &resp)
+{
+  cMutexLock lock(&m_Mutex);
+
+  // clients asking at the same time share one build
+  if (!source || source != m_Source || !m_Revision)
+  {
+    m_List.data.clear();
+    m_List.items.clear();
+    build(m_List);
+    m_Source = source;
+    Update();
+  }
+
+  // only a revision this journal handed out is a base for changes, one
+  // of another journal or run may fall in between its revisions
+  bool full = !std::binary_search(m_Issued.begin(), m_Issued.end(), since);
+
+  resp.add_U32(m_Revision);
+  resp.add_U8(full);
+
+  uint32_t count = 0;
+  if (!full)
+  {
+    for (const sDeleted &deleted : m_Deleted)
+      if (deleted.revision > since)
+        count++;
+  }
+  resp.add_U32(count);
+  if (!full)
+  {
+    for (const sDeleted &deleted : m_Deleted)
+      if (deleted.revision > since)
+        resp.add_U32(deleted.uid);
+  }
+
+  std::vector<const sItem*> changed;
+  for (const sItem &item : m_List.items)
+  {
+    if (full || m_Entries[item.uid].revision > since)
+      changed.push_back(&item);
+  }
+  resp.add_U32(changed.size());
+  for (const sItem *item : changed)
+    resp.copyin(m_List.data.data() + item->offset, item->length);
+}
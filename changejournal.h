@@ -0,0 +1,134 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <vdr/thread.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class cResponsePacket;
+
+/*!
+ * Remembers a list as sent to the clients, item by item, to answer with
+ * what changed since a revision instead of the whole list. There is one
+ * journal per list and selection, shared by all clients, so a client
+ * that reconnects can still sync by the changes. Items are compared by a
+ * hash of their serialised bytes, so anything a client would see makes
+ * an item count as updated. Revisions are drawn from a counter shared by
+ * all journals, which continues across restarts of VDR. A journal keeps
+ * the revisions it handed out and only takes those as a base: a revision
+ * from another journal, from an earlier run, or from before deletes were
+ * dropped from the log, is answered with the full list.
+ */
+class cChangeJournal
+{
+public:
+  struct sItem
+  {
+    uint32_t uid;
+    uint32_t offset;                             /*!> Serialised item in the list's data */
+    uint32_t length;
+  };
+
+  /*!
+   * A list serialised as in its full list response.
+   */
+  struct sList
+  {
+    std::vector<uint8_t> data;
+    std::vector<sItem> items;
+  };
+
+  enum eKind
+  {
+    CHANNELS_TV,
+    CHANNELS_RADIO,
+    TIMERS,
+    RECORDINGS
+  };
+
+  /*!
+   * The journal of a list. params tells apart the selections and
+   * formats the list is sent in.
+   */
+  static cChangeJournal &Get(eKind kind, uint32_t params);
+
+  cChangeJournal(const cChangeJournal &) = delete;
+  cChangeJournal &operator=(const cChangeJournal &) = delete;
+
+  /*!
+   * Write the changes since the revision to resp: the current revision,
+   * a U8 set if the client has to replace its list, the uids deleted and
+   * the items added or updated, in their serialised form. source
+   * identifies the state the list is built from, build is only called to
+   * diff a new list if it differs from the last call. 0 means unknown,
+   * the list is built each time.
+   */
+  void WriteChanges(uint32_t since, uint64_t source,
+                    const std::function<void(sList &list)> &build, cResponsePacket &resp);
+
+protected:
+  cChangeJournal() = default;
+
+  struct sEntry
+  {
+    uint64_t hash;
+    uint32_t revision;
+    uint32_t generation;
+  };
+
+  struct sDeleted
+  {
+    uint32_t uid;
+    uint32_t revision;
+  };
+
+  static const size_t MAX_DELETED = 1024;
+  static const size_t MAX_ISSUED = 4096;
+
+  void Update();
+  static uint32_t NextRevision();
+
+  cMutex m_Mutex;
+  sList m_List;                                  /*!> As last built */
+  uint64_t m_Source = 0;
+  std::unordered_map<uint32_t, sEntry> m_Entries;
+  std::deque<sDeleted> m_Deleted;
+  uint32_t m_Revision = 0;
+  std::deque<uint32_t> m_Issued;                 /*!> Revisions sent that changes can be based on, ascending */
+  uint32_t m_Generation = 0;
+
+  static cMutex m_JournalsMutex;
+  static std::unordered_map<uint64_t, std::unique_ptr<cChangeJournal>> m_Journals;
+  static cMutex m_RevisionMutex;
+  static uint32_t m_LastRevision;
+  static uint32_t m_ReservedRevision;            /*!> Saved as used by this run */
+};
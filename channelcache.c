@@ -0,0 +1,176 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
+#include "channelcache.h"
+#include "channelfilter.h"
+#include "hash.h"
+#include "responsepacket.h"
+
+#include <string>
+
+// part of this method is taken from XVDR
+static cString CreatePiconRef(const cChannel* channel)
+{
+  int hash = 0;
+
+  if(cSource::IsSat(channel->Source()))
+  {
+    int16_t pos = channel->Source() & cSource::st_Pos;
+    hash = pos;
+
+#if VDRVERSNUM >= 20101
+    if(hash < 0)
+    {
+      hash = 3600 + hash;
+    }
+#endif
+
+    hash = hash << 16;
+  }
+  else if(cSource::IsCable(channel->Source()))
+    hash = 0xFFFF0000;
+  else if(cSource::IsTerr(channel->Source()))
+    hash = 0xEEEE0000;
+  else if(cSource::IsAtsc(channel->Source()))
+    hash = 0xDDDD0000;
+
+  cString serviceref = cString::sprintf("1_0_%i_%X_%X_%X_%X_0_0_0",
+                                cVNSIChannelFilter::IsRadio(channel) ? 2 : (channel->Vtype() == 27) ? 19 : 1,
+                                channel->Sid(),
+                                channel->Tid(),
+                                channel->Nid(),
+                                hash);
+
+  return serviceref;
+}
+
+cChannelListCache &cChannelListCache::GetInstance()
+{
+  static cChannelListCache singleton;
+  return singleton;
+}
+
+std::shared_ptr<const cChannelListCache::sList> cChannelListCache::Get(bool radio, bool filter, bool piconRef)
+{
+  cMutexLock lock(&m_Mutex);
+
+  // taken before building, a change during the build is seen next time
+  uint32_t filterRevision = VNSIChannelFilter.GetRevision();
+  if (filterRevision != m_FilterRevision)
+  {
+    for (int r = 0; r < 2; r++)
+      for (int p = 0; p < 2; p++)
+        m_Lists[r][1][p].reset();
+    m_FilterRevision = filterRevision;
+  }
+
+  std::shared_ptr<const sList> &list = m_Lists[radio][filter][piconRef];
+
+#if VDRVERSNUM >= 20301
+  const cChannels *Channels = cChannels::GetChannelsRead(m_ChannelsKey);
+  if (Channels)
+  {
+    for (int r = 0; r < 2; r++)
+      for (int f = 0; f < 2; f++)
+        for (int p = 0; p < 2; p++)
+          m_Lists[r][f][p].reset();
+
+    list = Build(Channels, radio, filter, piconRef);
+    m_ChannelsKey.Remove(false);
+  }
+  else if (!list)
+  {
+    LOCK_CHANNELS_READ;
+    list = Build(Channels, radio, filter, piconRef);
+  }
+#else
+  // no state to tell a change, built on each request
+  Channels.Lock(false);
+  list = Build(&Channels, radio, filter, piconRef);
+  Channels.Unlock();
+#endif
+
+  return list;
+}
+
+std::shared_ptr<const cChannelListCache::sList> cChannelListCache::Build(const cChannels *channels, bool radio, bool filter, bool piconRef)
+{
+  std::shared_ptr<sList> list = std::make_shared<sList>();
+  list->serial = ++m_Serial;
+  cCharSetConv toUTF8;
+  cResponsePacket resp;
+  resp.init(0);
+  uint32_t headerLength = resp.getLen();
+
+  std::string caids;
+  int caid;
+  int caid_idx;
+  for (const cChannel *channel = channels->First(); channel; channel = channels->Next(channel))
+  {
+    if (radio != cVNSIChannelFilter::IsRadio(channel))
+      continue;
+
+    // skip invalid channels
+    if (channel->Sid() == 0)
+      continue;
+
+    if (endswith(channel->Name(), "OBSOLETE"))
+      continue;
+
+    // check filter
+    if (filter && !VNSIChannelFilter.PassFilter(*channel))
+      continue;
+
+    uint32_t start = resp.getLen();
+    uint32_t uuid = CreateChannelUID(channel);
+    resp.add_U32(channel->Number());
+    resp.add_String(toUTF8.Convert(channel->Name()));
+    resp.add_String(toUTF8.Convert(channel->Provider()));
+    resp.add_U32(uuid);
+    resp.add_U32(channel->Ca(0));
+    caid_idx = 0;
+    caids = "caids:";
+    while((caid = channel->Ca(caid_idx)) != 0)
+    {
+      caids += std::to_string(caid);
+      caids += ';';
+      caid_idx++;
+    }
+    resp.add_String(caids.c_str());
+    if (piconRef)
+    {
+      resp.add_String(CreatePiconRef(channel));
+    }
+    list->items.push_back(cChangeJournal::sItem{uuid, start - headerLength, resp.getLen() - start});
+  }
+
+  list->data.assign(resp.getPtr() + headerLength, resp.getPtr() + resp.getLen());
+  return list;
+}
@@ -0,0 +1,73 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include "changejournal.h"
+
+#include <vdr/thread.h>
+#include <vdr/channels.h>
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+/*!
+ * Channel lists serialised as in the channels response, shared by all
+ * clients. A list is built once for each selection and kept until the
+ * channels or the filter change, so clients asking at the same time do
+ * not each convert and format every channel.
+ */
+class cChannelListCache
+{
+public:
+  struct sList : cChangeJournal::sList
+  {
+    uint64_t serial;                             /*!> Changes whenever the list is built anew */
+  };
+
+  static cChannelListCache &GetInstance();
+
+  cChannelListCache(const cChannelListCache &) = delete;
+  cChannelListCache &operator=(const cChannelListCache &) = delete;
+
+  /*!
+   * The list of radio or TV channels, filtered or not. piconRef adds the
+   * picon reference of protocol 6 and later.
+   */
+  std::shared_ptr<const sList> Get(bool radio, bool filter, bool piconRef);
+
+protected:
+  cChannelListCache() = default;
+
+  std::shared_ptr<const sList> Build(const cChannels *channels, bool radio, bool filter, bool piconRef);
+
+  cMutex m_Mutex;
+  std::shared_ptr<const sList> m_Lists[2][2][2];  /*!> By radio, filter and piconRef */
+  uint32_t m_FilterRevision = 0;
+  uint64_t m_Serial = 0;
+#if VDRVERSNUM >= 20301
+  cStateKey m_ChannelsKey;
+#endif
+};
@@ -73,9 +73,16 @@ bool cVNSIChannelFilter::IsRadio(const cChannel* channel)
   return isRadio;
 }
 
+uint32_t cVNSIChannelFilter::GetRevision()
+{
+  cMutexLock lock(&m_Mutex);
+  return m_Revision;
+}
+
 void cVNSIChannelFilter::Load()
 {
   cMutexLock lock(&m_Mutex);
+  m_Revision++;
 
   cString filename;
   std::string line;
@@ -166,6 +173,7 @@ void cVNSIChannelFilter::StoreWhitelist(bool radio)
 {
   {
     cMutexLock lock(&m_Mutex);
+    m_Revision++;
 
     cString filename;
     std::ofstream wfile;
@@ -200,6 +208,7 @@ void cVNSIChannelFilter::StoreBlacklist(bool radio)
 {
   {
     cMutexLock lock(&m_Mutex);
+    m_Revision++;
 
     cString filename;
     std::ofstream wfile;
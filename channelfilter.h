@@ -51,11 +51,16 @@ public:
   bool PassFilter(const cChannel &channel);
   void SortChannels();
   static bool IsRadio(const cChannel* channel);
+  /*!
+   * Changes each time the filter lists are loaded or stored.
+   */
+  uint32_t GetRevision();
   std::vector<cVNSIProvider> m_providersVideo;
   std::vector<cVNSIProvider> m_providersRadio;
   std::set<int> m_channelsVideo;
   std::set<int> m_channelsRadio;
   cMutex m_Mutex;
+  uint32_t m_Revision = 0;
 };
 
 extern cVNSIChannelFilter VNSIChannelFilter;
@@ -34,8 +34,17 @@
 cVNSIServerConfig::cVNSIServerConfig()
 {
   listen_port         = LISTEN_PORT;
+  socket_path         = "";
+  socket_mode         = 0660;
   ConfigDirectory     = NULL;
   stream_timeout      = 10;
+  write_timeout       = 10;
+  batch_window        = 10;
+  zerocopy            = true;
+  uplink_rate         = 0;
+  max_clients         = 0;
+  max_live            = 0;
+  max_recordings      = 0;
   device              = false;
   pDevice             = NULL;
   testStreamActive    = false;
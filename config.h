@@ -28,6 +28,7 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include <vdr/config.h>
 
@@ -75,7 +76,16 @@ public:
   // Remote server settings
   cString ConfigDirectory;      // config directory path
   uint16_t listen_port;         // Port of remote server
+  cString socket_path;          // UNIX domain socket for local clients, none if empty
+  mode_t socket_mode;           // permissions of the UNIX domain socket
   uint16_t stream_timeout;      // timeout in seconds for stream data
+  uint16_t write_timeout;       // seconds a client may not read before it is dropped, 0 for no limit
+  uint16_t batch_window;        // milliseconds to gather mux packets into one batch, 0 to not wait
+  bool zerocopy;                // send large frames by reference where the socket supports it
+  uint32_t uplink_rate;         // kbit/s shared by streaming clients, 0 to not pace
+  int max_clients;              // connected clients, 0 for no limit
+  int max_live;                 // concurrent live streams, 0 for no limit
+  int max_recordings;           // concurrent recording streams, 0 for no limit
   bool device;                  // true if vnsi should act as dummy device
   void *pDevice;                // pointer to cDvbVnsiDevice
   cString testStreamFile;       // TS file to simulate channel
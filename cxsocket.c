@@ -39,12 +39,20 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <netinet/tcp.h>
 #include <net/if.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#endif
 
 #include <vdr/config.h>
 #include <vdr/tools.h>
@@ -53,6 +61,22 @@
 #define MSG_MORE 0
 #endif
 
+#ifdef __linux__
+// older headers, the kernel needs 4.14
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+#endif
+
 cxSocket::cxSocket(int h)
   :m_fd(h), m_pollerRead(m_fd), m_pollerWrite(m_fd, true)
 {
@@ -61,7 +85,32 @@ cxSocket::cxSocket(int h)
 cxSocket::~cxSocket()
 {
   if (m_fd >= 0)
+  {
+    // the kernel sends queued data after close() too, it may still read
+    // buffers passed by reference. Wait for it, what it has not sent by
+    // then is discarded with a reset instead of being sent from buffers
+    // already given back
+    if (m_zerocopyCount > 0)
+      FinishZerocopy(ZEROCOPY_CLOSE_MS);
+#ifdef __linux__
+    if (m_zerocopyCount > 0)
+    {
+      struct linger l;
+      l.l_onoff = 1;
+      l.l_linger = 0;
+      setsockopt(m_fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+    }
+#endif
     close(m_fd);
+  }
+
+  // nothing is sent from them any more, give the buffers back
+  for (; m_zerocopyCount > 0; m_zerocopyCount--)
+  {
+    sZerocopyBuffer &b = m_zerocopyPending[m_zerocopyHead];
+    b.done(b.context);
+    m_zerocopyHead = (m_zerocopyHead + 1) % MAX_ZEROCOPY_PENDING;
+  }
 }
 
 void cxSocket::Shutdown()
@@ -97,14 +146,16 @@ ssize_t cxSocket::write(const void *buffer, size_t size, int timeout_ms, bool mo
   if (m_fd < 0)
     return 0;
 
+  if (m_zerocopyCount > 0)
+    ReapZerocopy();
+
   ssize_t written = (ssize_t)size;
   const unsigned char *ptr = (const unsigned char *)buffer;
 
   while (size > 0)
   {
-    if (!m_pollerWrite.Poll(timeout_ms))
+    if (!PollWrite(timeout_ms, __FUNCTION__))
     {
-      ERRORLOG("cxSocket::write(fd=%d): poll() failed", m_fd);
       return written-size;
     }
 
@@ -129,6 +180,402 @@ ssize_t cxSocket::write(const void *buffer, size_t size, int timeout_ms, bool mo
   return written;
 }
 
+ssize_t cxSocket::writev(struct iovec *iov, int iovcnt, int timeout_ms)
+{
+  cMutexLock CmdLock(&m_MutexWrite);
+
+  if (m_fd < 0)
+    return 0;
+
+  if (m_zerocopyCount > 0)
+    ReapZerocopy();
+
+  size_t size = 0;
+  for (int i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
+
+  size_t left = size;
+  if (!SendMsg(iov, iovcnt, 0, left, timeout_ms, __FUNCTION__) && left == size)
+    return -1;
+  return size - left;
+}
+
+bool cxSocket::SendMsg(struct iovec *iov, int iovcnt, int flags, size_t &left, int timeout_ms, const char *caller)
+{
+  // m_MutexWrite is held
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+
+  while (left > 0)
+  {
+    if (!PollWrite(timeout_ms, caller))
+      return false;
+
+    ssize_t p = ::sendmsg(m_fd, &msg, flags | MSG_NOSIGNAL);
+
+    if (p <= 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+      {
+        DEBUGLOG("cxSocket::%s(fd=%d): EINTR during sendmsg(), retrying", caller, m_fd);
+        continue;
+      }
+      else if (errno != EPIPE && errno != ENOBUFS)
+        ERRORLOG("cxSocket::%s(fd=%d): sendmsg() error", caller, m_fd);
+      return false;
+    }
+
+#ifdef __linux__
+    // each successful send is a sequence number of the notifications
+    if (flags & MSG_ZEROCOPY)
+      m_zerocopySeq++;
+#endif
+
+    left -= p;
+
+    // skip what has been sent
+    while (msg.msg_iovlen > 0 && (size_t)p >= msg.msg_iov->iov_len)
+    {
+      p -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (p > 0)
+    {
+      msg.msg_iov->iov_base = (uint8_t*)msg.msg_iov->iov_base + p;
+      msg.msg_iov->iov_len -= p;
+    }
+  }
+
+  return true;
+}
+
+bool cxSocket::EnableZerocopy()
+{
+#ifdef __linux__
+  cMutexLock CmdLock(&m_MutexWrite);
+
+  int one = 1;
+  if (m_fd >= 0 && !m_zerocopy && setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0)
+    m_zerocopy = true;
+#endif
+  return m_zerocopy;
+}
+
+ssize_t cxSocket::writevZerocopy(struct iovec *iov, int iovcnt, void *const *contexts, tZerocopyDone done, int timeout_ms)
+{
+  cMutexLock CmdLock(&m_MutexWrite);
+
+  size_t size = 0;
+  for (int i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
+  size_t left = size;
+  bool failed = m_fd < 0;
+
+  if (!failed && m_zerocopyCount > 0)
+    ReapZerocopy();
+
+  // runs of entries without a context are sent by copy, each entry with
+  // one by reference. The lock is held throughout, the message is not
+  // mixed with other writers
+  int start = 0;
+  while (start < iovcnt)
+  {
+    void *context = contexts[start];
+    int end = start + 1;
+    if (!context)
+    {
+      while (end < iovcnt && !contexts[end])
+        end++;
+    }
+
+    size_t length = 0;
+    for (int i = start; i < end; i++)
+      length += iov[i].iov_len;
+    size_t rest = length;
+
+    if (failed)
+    {
+      // what is not sent must not wait for notifications
+    }
+#ifdef __linux__
+    else if (context && m_zerocopy && m_zerocopyCount < MAX_ZEROCOPY_PENDING)
+    {
+      uint32_t first = m_zerocopySeq;
+      if (!SendMsg(iov + start, 1, MSG_ZEROCOPY, rest, timeout_ms, __FUNCTION__))
+      {
+        // out of locked memory for the pages, send what is left by copy,
+        // the kernel still sends the first part from the buffer
+        if (errno == ENOBUFS)
+          SendMsg(iov + start, 1, 0, rest, timeout_ms, __FUNCTION__);
+        failed = rest > 0;
+      }
+
+      if (m_zerocopySeq != first)
+      {
+        int tail = (m_zerocopyHead + m_zerocopyCount) % MAX_ZEROCOPY_PENDING;
+        sZerocopyBuffer &b = m_zerocopyPending[tail];
+        b.first = first;
+        b.last = m_zerocopySeq - 1;
+        b.pending = m_zerocopySeq - first;
+        b.done = done;
+        b.context = context;
+        m_zerocopyCount++;
+        context = nullptr;
+      }
+    }
+#endif
+    else
+      failed = !SendMsg(iov + start, end - start, 0, rest, timeout_ms, __FUNCTION__);
+
+    // given back unless the kernel holds the buffer
+    if (context)
+      done(context);
+
+    left -= length - rest;
+    start = end;
+  }
+
+  if (left == size && size > 0)
+    return -1;
+  return size - left;
+}
+
+bool cxSocket::PollWrite(int timeout_ms, const char *caller)
+{
+  // m_MutexWrite is held. Unless the caller asks for a timeout, a client
+  // that stopped reading gets write_timeout to catch up. Then, or on an
+  // error, the stream of messages is broken: the socket is shut down, so
+  // that the other writers fail at once rather than waiting their turn,
+  // and the reactor sees the hangup and closes the connection.
+  if (timeout_ms < 0 && VNSIServerConfig.write_timeout > 0)
+    timeout_ms = VNSIServerConfig.write_timeout * 1000;
+
+  if (!m_broken && m_pollerWrite.Poll(timeout_ms))
+    return true;
+
+  if (!m_broken)
+  {
+    ERRORLOG("cxSocket::%s(fd=%d): poll() failed, closing the connection", caller, m_fd);
+    m_broken = true;
+    ::shutdown(m_fd, SHUT_RDWR);
+  }
+  return false;
+}
+
+void cxSocket::FinishZerocopy(int timeout_ms)
+{
+#ifdef __linux__
+  cMutexLock CmdLock(&m_MutexWrite);
+
+  // notifications come on the error queue, which poll reports as POLLERR
+  cTimeMs timeout(timeout_ms);
+  while (m_fd >= 0 && m_zerocopyCount > 0)
+  {
+    int count = m_zerocopyCount;
+    ReapZerocopy();
+    if (m_zerocopyCount == 0 || timeout.TimedOut())
+      break;
+    if (m_zerocopyCount == count)
+    {
+      struct pollfd pfd;
+      pfd.fd = m_fd;
+      pfd.events = 0;
+      int remaining = timeout_ms - (int)timeout.Elapsed();
+      if (remaining <= 0 || poll(&pfd, 1, remaining) <= 0)
+        break;
+      // a hangup without notifications would not wait
+      if (!(pfd.revents & POLLERR))
+        break;
+    }
+  }
+#endif
+}
+
+void cxSocket::ReapZerocopy()
+{
+#ifdef __linux__
+  // m_MutexWrite is held
+  while (m_zerocopyCount > 0)
+  {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(m_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      break;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+            (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+        continue;
+
+      struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      // e.g. on loopback, the kernel copies and pinning the pages is
+      // just overhead
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+      {
+        if (m_zerocopy)
+          INFOLOG("cxSocket(fd=%d): zerocopy sends are copied by the kernel, turned off", m_fd);
+        m_zerocopy = false;
+      }
+
+      // a range of sends is complete, mostly in order but not always
+      uint32_t lo = serr->ee_info;
+      uint32_t hi = serr->ee_data;
+      for (int i = 0; i < m_zerocopyCount; i++)
+      {
+        sZerocopyBuffer &b = m_zerocopyPending[(m_zerocopyHead + i) % MAX_ZEROCOPY_PENDING];
+        for (uint32_t seq = b.first; b.pending > 0 && seq - b.first <= b.last - b.first; seq++)
+        {
+          if (seq - lo <= hi - lo)
+            b.pending--;
+        }
+      }
+    }
+
+    while (m_zerocopyCount > 0 && m_zerocopyPending[m_zerocopyHead].pending == 0)
+    {
+      sZerocopyBuffer &b = m_zerocopyPending[m_zerocopyHead];
+      b.done(b.context);
+      m_zerocopyHead = (m_zerocopyHead + 1) % MAX_ZEROCOPY_PENDING;
+      m_zerocopyCount--;
+    }
+  }
+#endif
+}
+
+ssize_t cxSocket::sendfile(const void *header, size_t headerSize, int fd, off_t offset, size_t size, int timeout_ms)
+{
+  cMutexLock CmdLock(&m_MutexWrite);
+
+  if (m_fd < 0)
+    return 0;
+
+  if (write(header, headerSize, timeout_ms, true) != (ssize_t)headerSize)
+    return -1;
+
+  ssize_t written = (ssize_t)size;
+
+  while (size > 0)
+  {
+    if (!PollWrite(timeout_ms, __FUNCTION__))
+    {
+      return written-size;
+    }
+
+#ifdef __linux__
+    ssize_t p = ::sendfile(m_fd, fd, &offset, size);
+#else
+    unsigned char buffer[64*1024];
+    ssize_t p = pread(fd, buffer, size < sizeof(buffer) ? size : sizeof(buffer), offset);
+    if (p > 0)
+    {
+      p = write(buffer, p, timeout_ms);
+      if (p > 0)
+        offset += p;
+    }
+#endif
+
+    if (p < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+      {
+        DEBUGLOG("cxSocket::sendfile(fd=%d): EINTR during sendfile(), retrying", m_fd);
+        continue;
+      }
+      else if (errno != EPIPE)
+        ERRORLOG("cxSocket::sendfile(fd=%d): sendfile() error", m_fd);
+      return p;
+    }
+    else if (p == 0)
+    {
+      // the file got shorter than announced, the stream is broken now
+      ERRORLOG("cxSocket::sendfile(fd=%d): unexpected end of file", m_fd);
+      return written-size;
+    }
+
+    size -= p;
+  }
+
+  return written;
+}
+
+ssize_t cxSocket::writefds(const void *buffer, size_t size, const int *fds, int count)
+{
+  cMutexLock CmdLock(&m_MutexWrite);
+
+  if (m_fd < 0)
+    return 0;
+
+  struct iovec iov;
+  iov.iov_base = (void*)buffer;
+  iov.iov_len = size;
+
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * 4)];
+  } control;
+  if (count > 4)
+    return -1;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+  ssize_t p;
+  do
+  {
+    if (!PollWrite(-1, __FUNCTION__))
+      return -1;
+    p = ::sendmsg(m_fd, &msg, 0);
+  } while (p < 0 && (errno == EINTR || errno == EAGAIN));
+
+  if (p <= 0)
+  {
+    ERRORLOG("cxSocket::writefds(fd=%d): sendmsg() error", m_fd);
+    return p;
+  }
+
+  // the descriptors went with the first byte, the rest is plain data
+  if ((size_t)p < size)
+  {
+    ssize_t rest = write((const uint8_t*)buffer + p, size - p);
+    if (rest < 0)
+      return rest;
+    p += rest;
+  }
+  return p;
+}
+
+bool cxSocket::IsLocal()
+{
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (m_fd < 0 || getsockname(m_fd, (struct sockaddr *)&addr, &len) < 0)
+    return false;
+  return addr.ss_family == AF_UNIX;
+}
+
 ssize_t cxSocket::read(void *buffer, size_t size, int timeout_ms)
 {
   if (m_fd < 0)
@@ -174,6 +621,40 @@ ssize_t cxSocket::read(void *buffer, size_t size, int timeout_ms)
   return size;
 }
 
+ssize_t cxSocket::readsome(void *buffer, size_t size, int timeout_ms)
+{
+  if (m_fd < 0)
+    return 0;
+
+  for (int retryCounter = 0;; retryCounter++)
+  {
+    if(!m_pollerRead.Poll(timeout_ms))
+    {
+      ERRORLOG("cxSocket::readsome(fd=%d): poll() failed", m_fd);
+      return 0;
+    }
+
+    ssize_t p = ::read(m_fd, buffer, size);
+
+    if (p < 0)
+    {
+      if (retryCounter < 10 && (errno == EINTR || errno == EAGAIN))
+      {
+        DEBUGLOG("cxSocket::readsome(fd=%d): EINTR/EAGAIN during read(), retrying", m_fd);
+        continue;
+      }
+      ERRORLOG("cxSocket::readsome(fd=%d): read() error", m_fd);
+      return 0;
+    }
+    else if (p == 0)
+    {
+      INFOLOG("cxSocket::readsome(fd=%d): eof, connection closed", m_fd);
+      return 0;
+    }
+    return p;
+  }
+}
+
 char *cxSocket::ip2txt(uint32_t ip, unsigned int port, char *str)
 {
   // inet_ntoa is not thread-safe (?)
@@ -33,15 +33,41 @@
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <vdr/thread.h>
 #include <vdr/tools.h>
 
 class cxSocket
 {
+ public:
+  typedef void (*tZerocopyDone)(void *context);
+
+ private:
+  struct sZerocopyBuffer
+  {
+    uint32_t first;                              /*!> Sequence numbers of its sends */
+    uint32_t last;
+    uint32_t pending;                            /*!> Sends the kernel still holds */
+    tZerocopyDone done;
+    void *context;
+  };
+  static const int MAX_ZEROCOPY_PENDING = 64;
+  static const int ZEROCOPY_CLOSE_MS = 1000;     /*!> Waited for the kernel before closing */
+
   int m_fd;
   cMutex m_MutexWrite;
   cPoller m_pollerRead;
   cPoller m_pollerWrite;
+  bool m_broken = false;                         /*!> A write timed out, shut down */
+  bool m_zerocopy = false;
+  uint32_t m_zerocopySeq = 0;
+  sZerocopyBuffer m_zerocopyPending[MAX_ZEROCOPY_PENDING];
+  int m_zerocopyHead = 0;
+  int m_zerocopyCount = 0;
+
+  void ReapZerocopy();
+  bool SendMsg(struct iovec *iov, int iovcnt, int flags, size_t &left, int timeout_ms, const char *caller);
+  bool PollWrite(int timeout_ms, const char *caller);
 
  public:
   cxSocket(int h);
@@ -56,7 +82,56 @@ class cxSocket
   int GetHandle();
   void Invalidate();
   ssize_t read(void *buffer, size_t size, int timeout_ms = -1);
+  /*!
+   * Read what is available, at most size bytes. Returns 0 on eof or
+   * error.
+   */
+  ssize_t readsome(void *buffer, size_t size, int timeout_ms = -1);
   ssize_t write(const void *buffer, size_t size, int timeout_ms = -1, bool more_data = false);
+  /*!
+   * Send all buffers in one sendmsg() under one lock. Partial writes are
+   * continued by advancing the entries of iov, which is left modified.
+   */
+  ssize_t writev(struct iovec *iov, int iovcnt, int timeout_ms = -1);
+  /*!
+   * Let writevZerocopy pass buffers to the kernel by reference, where the
+   * socket supports SO_ZEROCOPY. Returns false if it does not.
+   */
+  bool EnableZerocopy();
+  bool IsZerocopy() { return m_zerocopy; }
+  /*!
+   * Send all buffers in order under one lock, like writev. An entry with
+   * a context is passed to the kernel by reference with MSG_ZEROCOPY and
+   * must stay untouched until done(context) is called, once the kernel
+   * has sent it. That may be before the return if it was sent by copy:
+   * when zerocopy is not enabled, too many buffers are pending, the write
+   * failed, or the kernel reported that it had to copy anyway, which
+   * turns zerocopy off for the socket. Entries without a context are
+   * sent by copy.
+   */
+  ssize_t writevZerocopy(struct iovec *iov, int iovcnt, void *const *contexts, tZerocopyDone done, int timeout_ms = -1);
+  /*!
+   * Give back the buffers the kernel has sent, waiting up to timeout_ms
+   * for the rest. Otherwise they are given back with the next write or
+   * when the socket is destroyed.
+   */
+  void FinishZerocopy(int timeout_ms);
+  /*!
+   * Send the header followed by size bytes of the file fd from offset on,
+   * under one lock. On Linux the file data is passed to the socket by the
+   * kernel without copying it through user space. Returns the number of
+   * file bytes sent.
+   */
+  ssize_t sendfile(const void *header, size_t headerSize, int fd, off_t offset, size_t size, int timeout_ms = -1);
+  /*!
+   * Write the buffer and pass the file descriptors along with it. Only
+   * works on unix domain sockets.
+   */
+  ssize_t writefds(const void *buffer, size_t size, const int *fds, int count);
+  /*!
+   * True for a unix domain socket, a client on this host.
+   */
+  bool IsLocal();
   static char *ip2txt(uint32_t ip, unsigned int port, char *str);
 };
 
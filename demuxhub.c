@@ -0,0 +1,670 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
+#include "demuxhub.h"
+#include "config.h"
+#include "vnsicommand.h"
+#include "videobuffer.h"
+#include "vnsi.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vdr/device.h>
+#include <vdr/recording.h>
+
+void SerialiseStreamChange(cVNSIDemuxer &demuxer, cResponsePacket &resp)
+{
+  resp.initStream(VNSI_STREAM_CHANGE, 0, 0, 0, 0, 0);
+
+  uint32_t FpsScale, FpsRate, Height, Width;
+  double Aspect;
+  uint32_t Channels, SampleRate, BitRate, BitsPerSample, BlockAlign;
+  for (cTSStream* stream = demuxer.GetFirstStream(); stream; stream = demuxer.GetNextStream())
+  {
+    resp.add_U32(stream->GetPID());
+    if (stream->Type() == stMPEG2AUDIO)
+    {
+      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
+      resp.add_String("MPEG2AUDIO");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(Channels);
+      resp.add_U32(SampleRate);
+      resp.add_U32(BlockAlign);
+      resp.add_U32(BitRate);
+      resp.add_U32(BitsPerSample);
+
+      for (const auto &i : stream->GetSideDataTypes())
+      {
+        resp.add_U32(i.first);
+        if (i.second == scRDS)
+        {
+          resp.add_String("RDS");
+          resp.add_String(stream->GetLanguage());
+          resp.add_U32(stream->GetPID());
+        }
+      }
+    }
+    else if (stream->Type() == stMPEG2VIDEO)
+    {
+      stream->GetVideoInformation(FpsScale, FpsRate, Height, Width, Aspect);
+      resp.add_String("MPEG2VIDEO");
+      resp.add_U32(FpsScale);
+      resp.add_U32(FpsRate);
+      resp.add_U32(Height);
+      resp.add_U32(Width);
+      resp.add_double(Aspect);
+    }
+    else if (stream->Type() == stAC3)
+    {
+      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
+      resp.add_String("AC3");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(Channels);
+      resp.add_U32(SampleRate);
+      resp.add_U32(BlockAlign);
+      resp.add_U32(BitRate);
+      resp.add_U32(BitsPerSample);
+    }
+    else if (stream->Type() == stH264)
+    {
+      stream->GetVideoInformation(FpsScale, FpsRate, Height, Width, Aspect);
+      resp.add_String("H264");
+      resp.add_U32(FpsScale);
+      resp.add_U32(FpsRate);
+      resp.add_U32(Height);
+      resp.add_U32(Width);
+      resp.add_double(Aspect);
+    }
+    else if (stream->Type() == stHEVC)
+    {
+      stream->GetVideoInformation(FpsScale, FpsRate, Height, Width, Aspect);
+      resp.add_String("HEVC");
+      resp.add_U32(FpsScale);
+      resp.add_U32(FpsRate);
+      resp.add_U32(Height);
+      resp.add_U32(Width);
+      resp.add_double(Aspect);
+    }
+    else if (stream->Type() == stDVBSUB)
+    {
+      resp.add_String("DVBSUB");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(stream->CompositionPageId());
+      resp.add_U32(stream->AncillaryPageId());
+    }
+    else if (stream->Type() == stTELETEXT)
+    {
+      resp.add_String("TELETEXT");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(stream->CompositionPageId());
+      resp.add_U32(stream->AncillaryPageId());
+    }
+    else if (stream->Type() == stAACADTS)
+    {
+      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
+      resp.add_String("AAC");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(Channels);
+      resp.add_U32(SampleRate);
+      resp.add_U32(BlockAlign);
+      resp.add_U32(BitRate);
+      resp.add_U32(BitsPerSample);
+    }
+    else if (stream->Type() == stAACLATM)
+    {
+      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
+      resp.add_String("AAC_LATM");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(Channels);
+      resp.add_U32(SampleRate);
+      resp.add_U32(BlockAlign);
+      resp.add_U32(BitRate);
+      resp.add_U32(BitsPerSample);
+    }
+    else if (stream->Type() == stEAC3)
+    {
+      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
+      resp.add_String("EAC3");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(Channels);
+      resp.add_U32(SampleRate);
+      resp.add_U32(BlockAlign);
+      resp.add_U32(BitRate);
+      resp.add_U32(BitsPerSample);
+    }
+    else if (stream->Type() == stDTS)
+    {
+      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
+      resp.add_String("DTS");
+      resp.add_String(stream->GetLanguage());
+      resp.add_U32(Channels);
+      resp.add_U32(SampleRate);
+      resp.add_U32(BlockAlign);
+      resp.add_U32(BitRate);
+      resp.add_U32(BitsPerSample);
+    }
+  }
+
+  resp.finaliseStream();
+}
+
+// cVideoInput signals new data, the timeout only covers sources without
+// a live input (recordings) and retune/CAM checks while no data arrives
+#define IDLE_WAIT_MS 100
+
+// --- cDemuxHub -------------------------------------------------------------
+
+cMutex cDemuxHub::m_HubsMutex;
+cCondVar cDemuxHub::m_HubsCond;
+std::list<std::shared_ptr<cDemuxHub>> cDemuxHub::m_Hubs;
+
+cDemuxHub::cDemuxHub(const cChannel *channel, int priority, bool allowRDS, int clientID, uint8_t timeshift)
+ : cThread("cDemuxHub demuxer")
+ , m_Channel(channel)
+ , m_ChannelID(channel->GetChannelID())
+ , m_Priority(priority)
+ , m_AllowRDS(allowRDS)
+ , m_ClientID(clientID)
+ , m_Timeshift(timeshift)
+ , m_Demuxer(allowRDS)
+ , m_VideoInput(m_Event)
+{
+  m_Closed = false;
+}
+
+cDemuxHub::~cDemuxHub()
+{
+  Stop();
+  Close();
+
+  if (m_LastChange)
+    m_LastChange->Release();
+}
+
+std::shared_ptr<cDemuxHub> cDemuxHub::Attach(const cChannel *channel, int priority, bool allowRDS,
+                                             cFrameQueue *queue, time_t &refTime, int64_t &refDTS)
+{
+  std::shared_ptr<cDemuxHub> hub;
+  {
+    cMutexLock lock(&m_HubsMutex);
+    for (auto &i : m_Hubs)
+    {
+      if (i->m_ChannelID == channel->GetChannelID() &&
+          i->m_AllowRDS == allowRDS &&
+          !i->m_Closed)
+      {
+        hub = i;
+        break;
+      }
+    }
+
+    if (hub)
+    {
+      // another client is tuning it, wait for the outcome
+      while (hub->m_Opening)
+        m_HubsCond.Wait(m_HubsMutex);
+      if (hub->m_Closed)
+        return nullptr;
+      hub->Subscribe(queue, priority, refTime, refDTS);
+      return hub;
+    }
+
+    // found by others while it opens, the other hubs are not held up
+    // by tuning
+    hub.reset(new cDemuxHub(channel, priority, allowRDS, -1, 0));
+    hub->m_Opening = true;
+    m_Hubs.push_back(hub);
+  }
+
+  bool opened = hub->Open();
+
+  cMutexLock lock(&m_HubsMutex);
+  hub->m_Opening = false;
+  m_HubsCond.Broadcast();
+  if (!opened)
+  {
+    hub->m_Closed = true;
+    m_Hubs.remove(hub);
+    return nullptr;
+  }
+
+  hub->Subscribe(queue, priority, refTime, refDTS);
+  hub->Start();
+  INFOLOG("Opened shared demuxer for channel %i - %s", channel->Number(), channel->Name());
+  return hub;
+}
+
+std::shared_ptr<cDemuxHub> cDemuxHub::OpenPrivate(const cChannel *channel, int priority, bool allowRDS,
+                                                  int clientID, uint8_t timeshift, int serial,
+                                                  cFrameQueue *queue, time_t &refTime, int64_t &refDTS)
+{
+  std::shared_ptr<cDemuxHub> hub(new cDemuxHub(channel, priority, allowRDS, clientID, timeshift));
+  if (!hub->Open(serial))
+    return nullptr;
+
+  hub->Subscribe(queue, priority, refTime, refDTS);
+  hub->Start();
+  return hub;
+}
+
+void cDemuxHub::Detach(std::shared_ptr<cDemuxHub> &hub, cFrameQueue *queue)
+{
+  bool last;
+  {
+    cMutexLock lock(&m_HubsMutex);
+    last = hub->Unsubscribe(queue);
+    if (last)
+      m_Hubs.remove(hub);
+  }
+
+  if (last)
+  {
+    INFOLOG("Closing shared demuxer for channel %s", hub->m_Channel->Name());
+    hub->Stop();
+  }
+  hub.reset();
+}
+
+bool cDemuxHub::Open(int serial)
+{
+  Close();
+
+#if APIVERSNUM >= 10725
+  m_Device = cDevice::GetDevice(m_Channel, m_Priority, true, true);
+#else
+  m_Device = cDevice::GetDevice(m_Channel, m_Priority, true);
+#endif
+
+  if (!m_Device)
+    return false;
+
+  bool recording = false;
+  if (VNSIServerConfig.testStreamActive) // test harness
+  {
+    recording = true;
+    m_VideoBuffer = cVideoBuffer::Create(VNSIServerConfig.testStreamFile);
+  }
+  else if (PlayRecording && serial == -1 && m_ClientID >= 0)
+  {
+#if VDRVERSNUM >= 20301
+    LOCK_TIMERS_READ;
+    for (const cTimer *timer = Timers->First(); timer; timer = Timers->Next(timer))
+#else
+    for (cTimer *timer = Timers.First(); timer; timer = Timers.Next(timer))
+#endif
+    {
+      if (timer &&
+          timer->Recording() &&
+          timer->Channel() == m_Channel)
+      {
+#if VDRVERSNUM >= 20301
+        LOCK_RECORDINGS_READ;
+        cTimer t(*timer);
+        cRecording matchRec(&t, t.Event());
+        const cRecording *rec;
+        {
+          rec = Recordings->GetByName(matchRec.FileName());
+          if (!rec)
+          {
+            return false;
+          }
+        }
+#else
+        Recordings.Load();
+        cRecording matchRec(timer, timer->Event());
+        cRecording *rec;
+        {
+          cThreadLock RecordingsLock(&Recordings);
+          rec = Recordings.GetByName(matchRec.FileName());
+          if (!rec)
+          {
+            return false;
+          }
+        }
+#endif
+        m_VideoBuffer = cVideoBuffer::Create(rec);
+        recording = true;
+        break;
+      }
+    }
+  }
+  if (!recording)
+  {
+    m_VideoBuffer = cVideoBuffer::Create(m_ClientID, m_Timeshift);
+  }
+
+  if (!m_VideoBuffer)
+    return false;
+
+  if (!recording)
+  {
+    if (!m_VideoInput.Open(m_Channel, m_Priority, m_VideoBuffer))
+    {
+      ERRORLOG("Can't switch to channel %i - %s", m_Channel->Number(), m_Channel->Name());
+      return false;
+    }
+  }
+
+  // without a buffer to hold back the stream, a slow client loses frames
+  // instead of stalling the receiver
+  m_Lossy = !recording && !m_VideoBuffer->HasBuffer();
+
+  m_Demuxer.Open(*m_Channel, m_VideoBuffer);
+  if (serial >= 0)
+    m_Demuxer.SetSerial(serial);
+
+  return true;
+}
+
+void cDemuxHub::Close()
+{
+  m_VideoInput.Close();
+  m_Demuxer.Close();
+  if (m_VideoBuffer)
+  {
+    delete m_VideoBuffer;
+    m_VideoBuffer = NULL;
+  }
+}
+
+void cDemuxHub::Subscribe(cFrameQueue *queue, int priority, time_t &refTime, int64_t &refDTS)
+{
+  cMutexLock lock(&m_SubscribersMutex);
+
+  // a late subscriber needs the stream layout and the time reference
+  // the others got with the first packet, and starts at an I-frame
+  queue->SetLossy(m_Lossy);
+  if (m_LastChange)
+    queue->Push(m_LastChange);
+  if (m_refTime)
+  {
+    refTime = m_refTime;
+    refDTS = m_refDTS;
+  }
+  m_Subscribers.push_back(queue);
+  m_Priorities[queue] = priority;
+  UpdatePriority();
+}
+
+bool cDemuxHub::Unsubscribe(cFrameQueue *queue)
+{
+  cMutexLock lock(&m_SubscribersMutex);
+  m_Subscribers.remove(queue);
+  m_Priorities.erase(queue);
+  UpdatePriority();
+  queue->WakeSpace();
+  return m_Subscribers.empty();
+}
+
+void cDemuxHub::UpdatePriority()
+{
+  // m_SubscribersMutex is held. The receiver runs at the priority of the
+  // most important viewer, so none of them is preempted by a lower one
+  if (m_Priorities.empty())
+    return;
+
+  int priority = m_Priorities.begin()->second;
+  for (const auto &i : m_Priorities)
+    priority = std::max(priority, i.second);
+
+  if (priority != m_Priority)
+  {
+    m_Priority = priority;
+    m_Event.Signal();
+  }
+}
+
+void cDemuxHub::Stop()
+{
+  // the thread blocks until data arrives or a queue has room, wake it
+  // up to notice
+  Cancel(-1);
+  m_Event.Signal();
+  {
+    cMutexLock lock(&m_SubscribersMutex);
+    for (auto *queue : m_Subscribers)
+      queue->WakeSpace();
+  }
+  Cancel(5);
+}
+
+void cDemuxHub::RetuneChannel(const cChannel *channel)
+{
+  if (m_Channel != channel || !m_VideoInput.IsOpen())
+    return;
+
+  INFOLOG("re-tune to channel %s", m_Channel->Name());
+  m_VideoInput.RequestRetune();
+}
+
+bool cDemuxHub::SeekTime(int64_t time, uint32_t &serial)
+{
+  bool ret = m_Demuxer.SeekTime(time);
+  serial = m_Demuxer.GetSerial();
+  return ret;
+}
+
+void cDemuxHub::Deliver(cStreamFrame *frame)
+{
+  if (m_Lossy)
+  {
+    cMutexLock lock(&m_SubscribersMutex);
+    for (auto *queue : m_Subscribers)
+      queue->Push(frame);
+    return;
+  }
+
+  // a private hub reading from a buffer waits for its streamer, the
+  // data stays in the buffer meanwhile. Unsubscribe and Stop wake it
+  while (Running())
+  {
+    cFrameQueue *queue;
+    {
+      cMutexLock lock(&m_SubscribersMutex);
+      if (m_Subscribers.empty())
+        return;
+      queue = m_Subscribers.front();
+      if (queue->Push(frame))
+        return;
+    }
+    queue->WaitForSpace();
+  }
+}
+
+void cDemuxHub::DeliverPacket(sStreamPacket *pkt)
+{
+  if (pkt->size == 0)
+    return;
+
+  size_t headerLength = m_streamHeader.getStreamHeaderLength();
+  cStreamFrame *frame = cStreamFramePool::GetInstance().Get(headerLength + pkt->size);
+  if (!frame)
+    return;
+
+  m_streamHeader.initStream(VNSI_STREAM_MUXPKT, pkt->id, pkt->duration, pkt->pts, pkt->dts, pkt->serial);
+  m_streamHeader.setLen(headerLength + pkt->size);
+  m_streamHeader.finaliseStream();
+
+  memcpy(frame->Data(), m_streamHeader.getPtr(), headerLength);
+  memcpy(frame->Data() + headerLength, pkt->data, pkt->size);
+  frame->SetSize(headerLength + pkt->size);
+  frame->kind = cStreamFrame::PACKET;
+  frame->id = pkt->id;
+  frame->pts = pkt->pts;
+  frame->dts = pkt->dts;
+  frame->duration = pkt->duration;
+  frame->serial = pkt->serial;
+  frame->reftime = pkt->reftime;
+  frame->frametype = pkt->frametype;
+
+  if (pkt->reftime)
+  {
+    cMutexLock lock(&m_SubscribersMutex);
+    m_refTime = pkt->reftime;
+    m_refDTS = pkt->dts;
+  }
+
+  Deliver(frame);
+  frame->Release();
+}
+
+void cDemuxHub::DeliverStreamChange()
+{
+  SerialiseStreamChange(m_Demuxer, m_changePacket);
+
+  cStreamFrame *frame = cStreamFramePool::GetInstance().Get(m_changePacket.getLen());
+  if (!frame)
+    return;
+
+  memcpy(frame->Data(), m_changePacket.getPtr(), m_changePacket.getLen());
+  frame->SetSize(m_changePacket.getLen());
+  frame->kind = cStreamFrame::STREAMCHANGE;
+
+  {
+    cMutexLock lock(&m_SubscribersMutex);
+    if (m_LastChange)
+      m_LastChange->Release();
+    frame->AddRef();
+    m_LastChange = frame;
+  }
+
+  Deliver(frame);
+  frame->Release();
+}
+
+void cDemuxHub::Action(void)
+{
+  int ret;
+  sStreamPacket pkt_data;
+  sStreamPacket pkt_side_data; // Additional data
+  memset(&pkt_data, 0, sizeof(sStreamPacket));
+  memset(&pkt_side_data, 0, sizeof(sStreamPacket));
+  bool requestStreamChangeData = false;
+  bool requestStreamChangeSideData = false;
+  int openFailCount = 0;
+
+  while (Running())
+  {
+    int priority = m_Priority;
+    if (priority != m_VideoInput.GetPriority() && m_VideoInput.IsOpen())
+    {
+      INFOLOG("Changing receiver priority of channel %s to %d", m_Channel->Name(), priority);
+      m_VideoInput.SetPriority(priority);
+    }
+
+    cVideoInput::eReceivingStatus retune = cVideoInput::NORMAL;
+    if (m_VideoInput.IsOpen())
+      retune = m_VideoInput.ReceivingStatus();
+    if (retune == cVideoInput::RETUNE)
+      ret = -1;
+    else
+      ret = m_Demuxer.Read(&pkt_data, &pkt_side_data);
+
+    if (ret > 0)
+    {
+      if (pkt_data.pmtChange)
+      {
+        requestStreamChangeData = true;
+        requestStreamChangeSideData = true;
+      }
+
+      if (pkt_data.data)
+      {
+        if (pkt_data.streamChange || requestStreamChangeData)
+          DeliverStreamChange();
+        requestStreamChangeData = false;
+        DeliverPacket(&pkt_data);
+        pkt_data.reftime = 0;
+      }
+
+      if (pkt_side_data.data)
+      {
+        if (pkt_side_data.streamChange || requestStreamChangeSideData)
+          DeliverStreamChange();
+        requestStreamChangeSideData = false;
+        DeliverPacket(&pkt_side_data);
+        pkt_side_data.data = NULL;
+      }
+    }
+    else if (ret == -1)
+    {
+      if (retune == cVideoInput::CLOSE)
+        break;
+      if (m_Demuxer.GetError() & ERROR_CAM_ERROR)
+      {
+        INFOLOG("CAM error, try reset");
+        cCamSlot *cs = m_Device->CamSlot();
+        if (cs)
+          cs->StopDecrypting();
+        retune = cVideoInput::RETUNE;
+      }
+      if (retune == cVideoInput::RETUNE)
+      {
+        INFOLOG("re-tuning...");
+        m_VideoInput.Close();
+        if (!m_VideoInput.Open(m_Channel, m_Priority, m_VideoBuffer))
+        {
+          if (++openFailCount == 3)
+          {
+            openFailCount = 0;
+            cCondWait::SleepMs(2000);
+          }
+          else
+            cCondWait::SleepMs(100);
+        }
+        else
+          openFailCount = 0;
+      }
+      else
+      {
+        // a wakeup that only armed the timer of the first pending data
+        // sleeps on until that is due or enough has arrived
+        int timeout = m_VideoInput.WakeupTimeout(IDLE_WAIT_MS);
+        if (timeout > 0)
+          m_Event.Wait(timeout);
+        timeout = m_VideoInput.WakeupTimeout(0);
+        if (timeout > 0)
+          m_Event.Wait(timeout);
+      }
+    }
+    else if (ret == -2)
+    {
+      if (!Open(m_Demuxer.GetSerial()))
+        break;
+    }
+  }
+
+  // let the subscribers notice that the input is gone
+  m_Closed = true;
+  cMutexLock lock(&m_SubscribersMutex);
+  for (auto *queue : m_Subscribers)
+    queue->Signal();
+
+  INFOLOG("exit shared demuxer thread");
+}
@@ -0,0 +1,125 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vdr/thread.h>
+#include <vdr/channels.h>
+
+#include "demuxer.h"
+#include "framequeue.h"
+#include "responsepacket.h"
+#include "videoinput.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+
+class cDevice;
+class cVideoBuffer;
+
+/*!
+ * Writes a VNSI_STREAM_CHANGE message for the demuxer's current streams.
+ */
+void SerialiseStreamChange(cVNSIDemuxer &demuxer, cResponsePacket &resp);
+
+/*!
+ * Demux stage of live streaming. A shared hub receives and demuxes one
+ * channel for all streamers watching it without timeshift: every frame
+ * is serialised once into a pooled cStreamFrame and queued to each
+ * subscriber, so the work scales with the number of channels rather than
+ * the number of viewers. A private hub does the same for a single
+ * streamer with its own (timeshift, recording or test) buffer.
+ */
+class cDemuxHub : public cThread
+{
+public:
+  virtual ~cDemuxHub();
+
+  cDemuxHub(const cDemuxHub &) = delete;
+  cDemuxHub &operator=(const cDemuxHub &) = delete;
+
+  /*!
+   * Subscribe the queue to the hub of the channel, opening a new one if
+   * nobody watches it yet. refTime and refDTS receive the reference of
+   * the running stream, or stay untouched if the hub has not seen one.
+   */
+  static std::shared_ptr<cDemuxHub> Attach(const cChannel *channel, int priority, bool allowRDS,
+                                           cFrameQueue *queue, time_t &refTime, int64_t &refDTS);
+  static std::shared_ptr<cDemuxHub> OpenPrivate(const cChannel *channel, int priority, bool allowRDS,
+                                                int clientID, uint8_t timeshift, int serial,
+                                                cFrameQueue *queue, time_t &refTime, int64_t &refDTS);
+  static void Detach(std::shared_ptr<cDemuxHub> &hub, cFrameQueue *queue);
+
+  cDevice *GetDevice() { return m_Device; }
+  bool IsClosed() { return m_Closed; }
+  uint32_t GetSerial() { return m_Demuxer.GetSerial(); }
+  uint16_t GetError() { return m_Demuxer.GetError(); }
+  void BufferStatus(bool &timeshift, uint32_t &start, uint32_t &end) { m_Demuxer.BufferStatus(timeshift, start, end); }
+  void RetuneChannel(const cChannel *channel);
+  bool SeekTime(int64_t time, uint32_t &serial);
+  void Stop();
+
+protected:
+  cDemuxHub(const cChannel *channel, int priority, bool allowRDS, int clientID, uint8_t timeshift);
+
+  virtual void Action(void);
+  bool Open(int serial = -1);
+  void Close();
+  void Subscribe(cFrameQueue *queue, int priority, time_t &refTime, int64_t &refDTS);
+  bool Unsubscribe(cFrameQueue *queue);
+  void UpdatePriority();
+  void Deliver(cStreamFrame *frame);
+  void DeliverPacket(sStreamPacket *pkt);
+  void DeliverStreamChange();
+
+  const cChannel *m_Channel;
+  tChannelID m_ChannelID;
+  std::atomic<int> m_Priority;                   /*!> Highest of the subscribers */
+  bool m_AllowRDS;
+  int m_ClientID;
+  uint8_t m_Timeshift;
+  bool m_Lossy = false;                          /*!> Live without a buffer, drop rather than wait */
+  cDevice *m_Device = nullptr;
+  cVideoBuffer *m_VideoBuffer = nullptr;
+  cVNSIDemuxer m_Demuxer;
+  cVideoInput m_VideoInput;
+  cCondWait m_Event;
+  cResponsePacket m_streamHeader;
+  cResponsePacket m_changePacket;
+  std::atomic<bool> m_Closed;
+
+  cMutex m_SubscribersMutex;
+  std::list<cFrameQueue*> m_Subscribers;
+  std::map<cFrameQueue*, int> m_Priorities;
+  cStreamFrame *m_LastChange = nullptr;          /*!> Replayed to late subscribers */
+  time_t m_refTime = 0;
+  int64_t m_refDTS = 0;
+
+  bool m_Opening = false;                        /*!> Tuning, guarded by m_HubsMutex */
+
+  static cMutex m_HubsMutex;
+  static cCondVar m_HubsCond;
+  static std::list<std::shared_ptr<cDemuxHub>> m_Hubs;
+};
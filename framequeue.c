@@ -0,0 +1,322 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "framequeue.h"
+#include "config.h"
+#include "parser.h"
+
+#include <stdlib.h>
+
+// --- cStreamFrame ----------------------------------------------------------
+
+cStreamFrame::~cStreamFrame()
+{
+  free(m_Buffer);
+}
+
+void cStreamFrame::Release()
+{
+  if (--m_RefCount == 0)
+    cStreamFramePool::GetInstance().Put(this);
+}
+
+// --- cStreamFramePool ------------------------------------------------------
+
+cStreamFramePool& cStreamFramePool::GetInstance()
+{
+  static cStreamFramePool singleton;
+  return singleton;
+}
+
+cStreamFramePool::~cStreamFramePool()
+{
+  for (int i = 0; i < NUM_CLASSES; i++)
+  {
+    while (m_Free[i])
+    {
+      cStreamFrame *frame = m_Free[i];
+      m_Free[i] = frame->m_Next;
+      delete frame;
+    }
+  }
+}
+
+cStreamFrame *cStreamFramePool::Get(size_t size)
+{
+  int sizeClass = 0;
+  size_t classSize = MIN_CLASS_SIZE;
+  while (classSize < size && sizeClass < NUM_CLASSES)
+  {
+    classSize <<= 1;
+    sizeClass++;
+  }
+
+  cStreamFrame *frame = nullptr;
+  if (sizeClass < NUM_CLASSES)
+  {
+    cMutexLock lock(&m_Mutex);
+    frame = m_Free[sizeClass];
+    if (frame)
+    {
+      m_Free[sizeClass] = frame->m_Next;
+      m_PooledBytes -= frame->m_Capacity;
+    }
+  }
+  else
+  {
+    // too big to be pooled
+    sizeClass = -1;
+    classSize = size;
+  }
+
+  if (!frame)
+  {
+    frame = new cStreamFrame;
+    frame->m_Buffer = (uint8_t*)malloc(classSize);
+    if (!frame->m_Buffer)
+    {
+      ERRORLOG("cStreamFramePool::Get - malloc failed");
+      delete frame;
+      return nullptr;
+    }
+    frame->m_Capacity = classSize;
+    frame->m_SizeClass = sizeClass;
+  }
+
+  frame->m_Next = nullptr;
+  frame->m_Size = 0;
+  frame->m_RefCount = 1;
+  frame->kind = cStreamFrame::PACKET;
+  frame->reftime = 0;
+  frame->frametype = 0;
+  return frame;
+}
+
+void cStreamFramePool::Put(cStreamFrame *frame)
+{
+  if (frame->m_SizeClass >= 0)
+  {
+    cMutexLock lock(&m_Mutex);
+    if (m_PooledBytes + frame->m_Capacity <= MAX_POOLED_BYTES)
+    {
+      frame->m_Next = m_Free[frame->m_SizeClass];
+      m_Free[frame->m_SizeClass] = frame;
+      m_PooledBytes += frame->m_Capacity;
+      return;
+    }
+  }
+  delete frame;
+}
+
+// --- cFrameQueue -----------------------------------------------------------
+
+cFrameQueue::cFrameQueue(cCondWait &event, size_t maxBytes, unsigned int maxFrames)
+ : m_Event(event)
+ , m_Frames(maxFrames + maxFrames / 2, nullptr)
+ , m_MaxBytes(maxBytes)
+ , m_MaxFrames(maxFrames)
+{
+  m_Overflow = false;
+}
+
+cFrameQueue::~cFrameQueue()
+{
+  Clear();
+}
+
+void cFrameQueue::SetLossy(bool lossy)
+{
+  cMutexLock lock(&m_Mutex);
+  m_Lossy = lossy;
+  m_WaitIFrame = lossy;
+}
+
+bool cFrameQueue::HasRoom(cStreamFrame *frame, bool reserve)
+{
+  unsigned int maxFrames = reserve ? m_Frames.size() : m_MaxFrames;
+  size_t maxBytes = reserve ? m_MaxBytes + m_MaxBytes / 2 : m_MaxBytes;
+
+  if (m_Count >= maxFrames)
+    return false;
+  return m_Count == 0 || m_Bytes + frame->Size() <= maxBytes;
+}
+
+void cFrameQueue::Drop(unsigned int index)
+{
+  cStreamFrame *&slot = m_Frames[(m_Head + index) % m_Frames.size()];
+
+  m_Bytes -= slot->Size();
+  m_Dropped++;
+  slot->Release();
+  slot = nullptr;
+}
+
+void cFrameQueue::Compact()
+{
+  unsigned int size = m_Frames.size();
+  unsigned int count = 0;
+
+  for (unsigned int i = 0; i < m_Count; i++)
+  {
+    cStreamFrame *frame = m_Frames[(m_Head + i) % size];
+    if (!frame)
+      continue;
+    m_Frames[(m_Head + i) % size] = nullptr;
+    m_Frames[(m_Head + count) % size] = frame;
+    count++;
+  }
+  m_Count = count;
+}
+
+void cFrameQueue::DropFrames()
+{
+  unsigned int size = m_Frames.size();
+
+  // frames are released in place and the ring closed up once per pass,
+  // rather than shifting it for every frame
+
+  // nothing refers to B-frames, they go first
+  for (unsigned int i = 0; i < m_Count; i++)
+  {
+    if (m_Frames[(m_Head + i) % size]->frametype == PKT_B_FRAME)
+      Drop(i);
+  }
+  Compact();
+  if (m_Count < m_MaxFrames && m_Bytes <= m_MaxBytes)
+    return;
+
+  // then the oldest P-frame and all video depending on it, up to the
+  // next I-frame
+  unsigned int i = 0;
+  while (i < m_Count && m_Frames[(m_Head + i) % size]->frametype != PKT_P_FRAME)
+    i++;
+  if (i == m_Count)
+    return;
+
+  bool iframe = false;
+  for (; i < m_Count; i++)
+  {
+    uint8_t frametype = m_Frames[(m_Head + i) % size]->frametype;
+    if (frametype == PKT_I_FRAME)
+    {
+      iframe = true;
+      break;
+    }
+    if (frametype)
+      Drop(i);
+  }
+  Compact();
+
+  // no I-frame queued, what comes next depends on the dropped frames
+  if (!iframe)
+    m_WaitIFrame = true;
+}
+
+bool cFrameQueue::Push(cStreamFrame *frame)
+{
+  {
+    cMutexLock lock(&m_Mutex);
+
+    bool dependent = frame->frametype == PKT_P_FRAME || frame->frametype == PKT_B_FRAME;
+    if (m_Lossy && frame->frametype == PKT_I_FRAME)
+      m_WaitIFrame = false;
+    else if (m_Lossy && dependent && m_WaitIFrame)
+    {
+      m_Dropped++;
+      return true;
+    }
+
+    if (!HasRoom(frame, false))
+    {
+      if (!m_Lossy)
+        return false;
+
+      DropFrames();
+      if (dependent && (m_WaitIFrame || !HasRoom(frame, false)))
+      {
+        if (frame->frametype == PKT_P_FRAME)
+          m_WaitIFrame = true;
+        m_Dropped++;
+        return true;
+      }
+
+      // audio, I-frames and stream changes are never dropped by choice
+      if (!HasRoom(frame, true))
+      {
+        m_Overflow = true;
+        m_Dropped++;
+        return false;
+      }
+    }
+
+    frame->AddRef();
+    m_Frames[(m_Head + m_Count) % m_Frames.size()] = frame;
+    m_Count++;
+    m_Bytes += frame->Size();
+  }
+  m_Event.Signal();
+  return true;
+}
+
+cStreamFrame *cFrameQueue::Pop()
+{
+  cStreamFrame *frame;
+  {
+    cMutexLock lock(&m_Mutex);
+    if (m_Count == 0)
+      return nullptr;
+
+    frame = m_Frames[m_Head];
+    m_Frames[m_Head] = nullptr;
+    m_Head = (m_Head + 1) % m_Frames.size();
+    m_Count--;
+    m_Bytes -= frame->Size();
+  }
+  m_SpaceEvent.Signal();
+  return frame;
+}
+
+void cFrameQueue::Clear()
+{
+  {
+    cMutexLock lock(&m_Mutex);
+    while (m_Count)
+    {
+      m_Frames[m_Head]->Release();
+      m_Frames[m_Head] = nullptr;
+      m_Head = (m_Head + 1) % m_Frames.size();
+      m_Count--;
+    }
+    m_Bytes = 0;
+    m_Overflow = false;
+  }
+  m_SpaceEvent.Signal();
+}
+
+void cFrameQueue::GetStats(unsigned int &frames, size_t &bytes, unsigned int &dropped)
+{
+  cMutexLock lock(&m_Mutex);
+  frames = m_Count;
+  bytes = m_Bytes;
+  dropped = m_Dropped;
+}
@@ -0,0 +1,150 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+#include <vdr/thread.h>
+
+/*!
+ * A stream message (header and payload) serialised into a refcounted
+ * buffer. The demuxing side fills it once, every streamer holding a
+ * reference only writes the bytes to its socket.
+ */
+class cStreamFrame
+{
+  friend class cStreamFramePool;
+public:
+  enum eKind
+  {
+    PACKET,
+    STREAMCHANGE
+  };
+
+  void AddRef() { m_RefCount++; }
+  void Release();
+
+  uint8_t *Data() { return m_Buffer; }
+  size_t Size() const { return m_Size; }
+  void SetSize(size_t size) { m_Size = size; }
+
+  eKind kind;
+  uint32_t id;
+  int64_t pts;
+  int64_t dts;
+  uint32_t duration;
+  uint32_t serial;
+  time_t reftime;
+  uint8_t frametype;                             /*!> PKT_x_FRAME for video, 0 otherwise */
+
+private:
+  cStreamFrame() = default;
+  ~cStreamFrame();
+
+  std::atomic<int> m_RefCount;
+  uint8_t *m_Buffer = nullptr;
+  size_t m_Capacity = 0;
+  size_t m_Size = 0;
+  int m_SizeClass = -1;
+  cStreamFrame *m_Next = nullptr;
+};
+
+/*!
+ * Recycles frames and their buffers in power of two size classes, so
+ * the streaming path does not hit the allocator once it has warmed up.
+ */
+class cStreamFramePool
+{
+public:
+  static cStreamFramePool& GetInstance();
+
+  cStreamFrame *Get(size_t size);
+  void Put(cStreamFrame *frame);
+
+protected:
+  cStreamFramePool() = default;
+  virtual ~cStreamFramePool();
+
+private:
+  static const int MIN_CLASS_SIZE = 512;
+  static const int NUM_CLASSES = 13;             /*!> 512 bytes up to 2 MB */
+  static const size_t MAX_POOLED_BYTES = 32*1024*1024;
+
+  cMutex m_Mutex;
+  cStreamFrame *m_Free[NUM_CLASSES] = { nullptr };
+  size_t m_PooledBytes = 0;
+};
+
+/*!
+ * Bounded FIFO of frames between a demux stage and a sending streamer.
+ * Push signals the consumer's event. A full queue refuses the frame,
+ * unless it is lossy: then it drops B-frames first, then P-frames up to
+ * the next I-frame, and never audio. Audio, I-frames and stream changes
+ * may use a reserve above the limits; only when that is exhausted too
+ * the frame is refused and the queue remembers that it overflowed.
+ */
+class cFrameQueue
+{
+public:
+  cFrameQueue(cCondWait &event, size_t maxBytes, unsigned int maxFrames);
+  virtual ~cFrameQueue();
+
+  cFrameQueue(const cFrameQueue &) = delete;
+  cFrameQueue &operator=(const cFrameQueue &) = delete;
+
+  bool Push(cStreamFrame *frame);
+  cStreamFrame *Pop();
+  void Clear();
+  void Signal() { m_Event.Signal(); }
+  /*!
+   * Block until a frame was taken or WakeSpace is called.
+   */
+  void WaitForSpace() { m_SpaceEvent.Wait(); }
+  void WakeSpace() { m_SpaceEvent.Signal(); }
+  bool Overflowed() { return m_Overflow; }
+  void SetLossy(bool lossy);
+  void GetStats(unsigned int &frames, size_t &bytes, unsigned int &dropped);
+
+protected:
+  bool HasRoom(cStreamFrame *frame, bool reserve);
+  void DropFrames();
+  void Drop(unsigned int index);
+  void Compact();
+
+  cMutex m_Mutex;
+  cCondWait &m_Event;
+  cCondWait m_SpaceEvent;
+  std::vector<cStreamFrame*> m_Frames;           /*!> Ring of queued frames, including the reserve */
+  unsigned int m_Head = 0;
+  unsigned int m_Count = 0;
+  size_t m_Bytes = 0;
+  const size_t m_MaxBytes;
+  const unsigned int m_MaxFrames;
+  bool m_Lossy = false;
+  bool m_WaitIFrame = false;                     /*!> Drop video until the next I-frame */
+  unsigned int m_Dropped = 0;
+  std::atomic<bool> m_Overflow;
+};
@@ -23,10 +23,19 @@
  *
  */
 
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
 #include "hash.h"
 
 #include <vdr/tools.h>
 #include <vdr/channels.h>
+#include <vdr/thread.h>
+
+#include <unordered_map>
 
 static uint32_t crc32_tab[] = {
 	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -97,19 +106,39 @@ uint32_t CreateChannelUID(const cChannel* channel) {
   return CreateStringHash(channelid);
 }
 
+#if VDRVERSNUM >= 20301
+/*
+ * UID to channel, shared by all threads and rebuilt when the state of the
+ * channels list differs from the one it was built for. Pointers stay as
+ * valid as with the former linear search, which also returned them after
+ * unlocking. The channels are always locked before the index mutex: with
+ * the read lock held, locking them again for the index key only nests and
+ * never waits, and callers may hold the channels lock themselves.
+ */
+static cMutex channelIndexMutex;
+static cStateKey channelIndexKey;
+static std::unordered_map<uint32_t, const cChannel*> channelIndex;
+#endif
+
 const cChannel* FindChannelByUID(uint32_t channelUID) {
   const cChannel* result = NULL;
 
 #if VDRVERSNUM >= 20301
   LOCK_CHANNELS_READ;
-  // maybe we need to use a lookup table
-  for (const cChannel *channel = Channels->First(); channel; channel = Channels->Next(channel)) {
-    cString channelid = channel->GetChannelID().ToString();
-    if(channelUID == CreateStringHash(channelid)) {
-      result = channel;
-      break;
+  cMutexLock lock(&channelIndexMutex);
+  if (cChannels::GetChannelsRead(channelIndexKey)) {
+    channelIndex.clear();
+    channelIndex.reserve(Channels->Count());
+    for (const cChannel *channel = Channels->First(); channel; channel = Channels->Next(channel)) {
+      // the first one wins on a collision, as with the search
+      channelIndex.emplace(CreateChannelUID(channel), channel);
     }
+    channelIndexKey.Remove(false);
   }
+
+  auto it = channelIndex.find(channelUID);
+  if (it != channelIndex.end())
+    result = it->second;
 #else
   // maybe we need to use a lookup table
   Channels.Lock(false);
@@ -0,0 +1,242 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "pacer.h"
+#include "config.h"
+#include "cxsocket.h"
+#include "parser.h"
+
+#include <sys/socket.h>
+
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
+#define PACING_HEADROOM   1.5   // allowed above the measured demand
+#define MEASURE_SECONDS   2     // stream time a demand is measured over
+#define BURST_MS          100   // what the bucket may hold
+#define MIN_BURST         (64*1024)
+#define MAX_WAIT_MS       500
+#define MIN_BLOCK         (16*1024) // a limited block is never empty
+
+cMutex cPacer::m_PacersMutex;
+cPacer *cPacer::m_First = nullptr;
+
+cPacer::cPacer(cxSocket &socket)
+ : m_Socket(socket)
+{
+  m_KernelPacing = true;
+  m_LastRefill = m_WindowStart = cTimeMs::Now();
+
+  cMutexLock lock(&m_PacersMutex);
+  m_Next = m_First;
+  m_First = this;
+}
+
+cPacer::~cPacer()
+{
+  {
+    cMutexLock lock(&m_PacersMutex);
+    for (cPacer **p = &m_First; *p; p = &(*p)->m_Next)
+    {
+      if (*p == this)
+      {
+        *p = m_Next;
+        break;
+      }
+    }
+  }
+  Rebalance();
+}
+
+bool cPacer::Enabled()
+{
+  return VNSIServerConfig.uplink_rate > 0;
+}
+
+void cPacer::SetDemand(eSource source, uint64_t rate)
+{
+  {
+    cMutexLock lock(&m_PacersMutex);
+    if (m_Demand[source] == rate)
+      return;
+    m_Demand[source] = rate;
+  }
+  Rebalance();
+}
+
+void cPacer::AddMedia(eSource source, size_t bytes, int64_t dts)
+{
+  // only the thread sending the source measures it
+  sMeasure &m = m_Measure[source];
+  if (dts == DVD_NOPTS_VALUE)
+    return;
+
+  // start over on jumps, a new stream or a seek
+  if (m.bytes == 0 || dts < m.startDTS || dts - m.startDTS > 10 * MEASURE_SECONDS * DVD_TIME_BASE)
+  {
+    m.startDTS = dts;
+    m.bytes = bytes;
+    return;
+  }
+
+  m.bytes += bytes;
+  int64_t span = dts - m.startDTS;
+  if (span < MEASURE_SECONDS * DVD_TIME_BASE)
+    return;
+
+  uint64_t rate = m.bytes * DVD_TIME_BASE / span;
+  m.startDTS = dts;
+  m.bytes = 0;
+
+  // only a notable change is worth rebalancing all clients
+  uint64_t demand;
+  {
+    cMutexLock lock(&m_PacersMutex);
+    demand = m_Demand[source];
+    if (demand && rate * 10 > demand * 9 && rate * 10 < demand * 11)
+      return;
+    m_Demand[source] = rate;
+  }
+  Rebalance();
+}
+
+void cPacer::Wait(size_t bytes)
+{
+  int waitMs = 0;
+  {
+    cMutexLock lock(&m_BucketMutex);
+    Refill();
+    Take(bytes);
+    if (m_Target && !m_KernelPacing && m_Tokens < 0)
+    {
+      waitMs = -m_Tokens * 1000 / m_Target;
+      if (waitMs > MAX_WAIT_MS)
+        waitMs = MAX_WAIT_MS;
+    }
+  }
+
+  if (waitMs > 0)
+    cCondWait::SleepMs(waitMs);
+}
+
+size_t cPacer::Limit(size_t bytes)
+{
+  cMutexLock lock(&m_BucketMutex);
+  Refill();
+  if (m_Target && !m_KernelPacing && m_Tokens < bytes)
+  {
+    size_t allowed = m_Tokens > MIN_BLOCK ? (size_t)m_Tokens : MIN_BLOCK;
+    if (allowed < bytes)
+      bytes = allowed;
+  }
+  Take(bytes);
+  return bytes;
+}
+
+void cPacer::Refill()
+{
+  // m_BucketMutex is held
+  uint64_t now = cTimeMs::Now();
+
+  if (now - m_WindowStart >= 1000)
+  {
+    m_Achieved = m_WindowBytes * 1000 / (now - m_WindowStart);
+    m_WindowStart = now;
+    m_WindowBytes = 0;
+  }
+
+  if (m_Target && !m_KernelPacing)
+  {
+    double burst = m_Target * BURST_MS / 1000.0;
+    if (burst < MIN_BURST)
+      burst = MIN_BURST;
+    m_Tokens += m_Target * (now - m_LastRefill) / 1000.0;
+    if (m_Tokens > burst)
+      m_Tokens = burst;
+  }
+  m_LastRefill = now;
+}
+
+void cPacer::Take(size_t bytes)
+{
+  // m_BucketMutex is held
+  m_WindowBytes += bytes;
+  if (m_Target && !m_KernelPacing)
+    m_Tokens -= bytes;
+}
+
+void cPacer::GetRates(uint64_t &achieved, uint64_t &target)
+{
+  cMutexLock lock(&m_BucketMutex);
+  achieved = m_Achieved;
+  target = m_Target;
+}
+
+uint64_t cPacer::GetDemand()
+{
+  // m_PacersMutex is held
+  uint64_t demand = 0;
+  for (int i = 0; i < SOURCES; i++)
+    demand += m_Demand[i];
+  return demand * PACING_HEADROOM;
+}
+
+void cPacer::SetTarget(uint64_t rate)
+{
+  cMutexLock lock(&m_BucketMutex);
+  m_Target = rate;
+
+  if (!m_KernelPacing || rate == m_KernelRate)
+    return;
+
+  // the kernel takes 32 bits, ~0U is unlimited
+  unsigned int value = rate == 0 || rate >= ~0U ? ~0U : (unsigned int)rate;
+  if (setsockopt(m_Socket.GetHandle(), SOL_SOCKET, SO_MAX_PACING_RATE, &value, sizeof(value)) < 0)
+  {
+    INFOLOG("SO_MAX_PACING_RATE not supported, pacing by the server");
+    m_KernelPacing = false;
+    return;
+  }
+  m_KernelRate = rate;
+}
+
+void cPacer::Rebalance()
+{
+  uint64_t uplink = (uint64_t)VNSIServerConfig.uplink_rate * 1000 / 8;
+
+  cMutexLock lock(&m_PacersMutex);
+  uint64_t total = 0;
+  for (cPacer *p = m_First; p; p = p->m_Next)
+    total += p->GetDemand();
+
+  for (cPacer *p = m_First; p; p = p->m_Next)
+  {
+    uint64_t demand = p->GetDemand();
+    if (total > uplink && demand)
+      p->SetTarget(uplink * demand / total);
+    else
+      p->SetTarget(demand);
+  }
+}
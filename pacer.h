@@ -0,0 +1,124 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+class cxSocket;
+
+/*!
+ * Paces what the streaming paths send to one client, if an uplink rate
+ * is configured. Each source reports the rate its media needs, the live
+ * stream from its timestamps and a recording from its average bitrate.
+ * A client is allowed its demand plus headroom; when the demand of all
+ * clients exceeds the uplink, each gets a share of it weighted by its
+ * demand. The rate is handed to the kernel with SO_MAX_PACING_RATE where
+ * that works, otherwise a token bucket delays the writes. Unix domain
+ * sockets are not paced, clients on them have no pacer and do not count
+ * against the uplink.
+ */
+class cPacer
+{
+public:
+  enum eSource
+  {
+    LIVE,
+    RECORDING,
+    SOURCES
+  };
+
+  cPacer(cxSocket &socket);
+  virtual ~cPacer();
+
+  cPacer(const cPacer &) = delete;
+  cPacer &operator=(const cPacer &) = delete;
+
+  static bool Enabled();
+
+  /*!
+   * Set the bytes per second a source needs, 0 when it stops.
+   */
+  void SetDemand(eSource source, uint64_t rate);
+
+  /*!
+   * Account media of the source with its DTS, the demand is measured
+   * over a few seconds of stream time.
+   */
+  void AddMedia(eSource source, size_t bytes, int64_t dts);
+
+  /*!
+   * Account bytes about to be sent, waiting until the bucket allows them
+   * unless the kernel paces the socket.
+   */
+  void Wait(size_t bytes);
+
+  /*!
+   * Account bytes about to be sent without waiting, for requests served
+   * by shared workers. Returns how many of them the bucket allows now, a
+   * small block at least, the client asks again for the rest.
+   */
+  size_t Limit(size_t bytes);
+
+  /*!
+   * Bytes per second sent in the last second and allowed now, 0 if not
+   * limited.
+   */
+  void GetRates(uint64_t &achieved, uint64_t &target);
+
+protected:
+  struct sMeasure
+  {
+    int64_t startDTS = 0;
+    uint64_t bytes = 0;
+  };
+
+  void Refill();
+  void Take(size_t bytes);
+  uint64_t GetDemand();
+  void SetTarget(uint64_t rate);
+  static void Rebalance();
+
+  cxSocket &m_Socket;
+  bool m_KernelPacing;
+  uint64_t m_Demand[SOURCES] = {};
+  sMeasure m_Measure[SOURCES];
+  uint64_t m_Target = 0;
+  uint64_t m_KernelRate = 0;
+
+  cMutex m_BucketMutex;
+  double m_Tokens = 0;
+  uint64_t m_LastRefill;
+  uint64_t m_WindowStart;
+  uint64_t m_WindowBytes = 0;
+  uint64_t m_Achieved = 0;
+
+  static cMutex m_PacersMutex;
+  static cPacer *m_First;
+  cPacer *m_Next = nullptr;
+};
@@ -72,6 +72,7 @@ void cParser::Reset()
   m_PesNextFramePtr = 0;
   m_FoundFrame = false;
   m_FrameValid = false;
+  m_FrameType = 0;
   m_PesPacketLength = 0;
   m_PesHeaderPtr = 0;
   m_Error = ERROR_PES_GENERAL;
@@ -374,7 +375,17 @@ bool cParser::AddPESPacket(uint8_t *data, int size)
       Reset();
       return false;
     }
-    m_PesBufferSize += m_PesBufferInitialSize / 10;
+    // grow by half the current size, so the buffer settles after a few
+    // reallocs instead of creeping up frame by frame
+    int step = m_PesBufferSize / 2;
+    if (step < (int)m_PesBufferInitialSize / 10)
+      step = m_PesBufferInitialSize / 10;
+    int newSize = m_PesBufferSize + step;
+    if (newSize <= m_PesBufferPtr + size)
+      newSize = m_PesBufferPtr + size + 1;
+    if (newSize > 1000000)
+      newSize = 1000000;
+    m_PesBufferSize = newSize;
     uint8_t *new_buffer = (uint8_t*)realloc(m_PesBuffer, m_PesBufferSize);
     if (new_buffer == NULL)
     {
@@ -582,12 +593,15 @@ int cTSStream::ProcessTSPacket(uint8_t *data, sStreamPacket *pkt, sStreamPacket
     if (pkt->pts != DVD_NOPTS_VALUE)
       pkt->pts      = Rescale(pts, DVD_TIME_BASE, 90000);
     pkt->duration = Rescale(pkt->duration, DVD_TIME_BASE, 90000);
+    pkt->frametype = m_pesParser->m_FrameType;
 
     ret = 0;
   }
 
   if (pkt_side_data && pkt_side_data->data)
   {
+    pkt_side_data->frametype = 0;
+
     int64_t dts = pkt_side_data->dts;
     int64_t pts = pkt_side_data->pts;
 
@@ -111,7 +111,7 @@ enum eStreamType
 
 #define PKT_I_FRAME 1
 #define PKT_P_FRAME 2
-#define PKT_B_FRAME 3
+#define PKT_B_FRAME 3 /* also used for any picture no other frame refers to */
 #define PKT_NTYPES  4
 struct sStreamPacket
 {
@@ -122,6 +122,7 @@ struct sStreamPacket
 
   uint8_t   commercial;
   uint8_t   componentindex;
+  uint8_t   frametype;      /* PKT_x_FRAME for video, 0 otherwise */
 
   uint8_t  *data;
   int       size;
@@ -176,6 +177,7 @@ protected:
 
   bool        m_FoundFrame;
   bool        m_FrameValid;
+  int         m_FrameType;
 
   int         m_pID;
   int64_t     m_curPTS;
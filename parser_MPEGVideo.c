@@ -274,6 +274,7 @@ bool cParserMPEG2Video::Parse_MPEG2Video_PicStart(uint8_t *buf)
 
   if (pct == PKT_I_FRAME)
     m_NeedIFrame = false;
+  m_FrameType = pct;
 
   int vbvDelay = bs.readBits(16); /* vbv_delay */
   if (vbvDelay  == 0xffff)
@@ -186,6 +186,15 @@ int cParserH264::Parse_H264(uint32_t startcode, int buf_ptr, bool &complete)
         m_DTS = m_prevDTS;
         m_PTS = m_prevPTS;
       }
+
+      // classify by the first slice, pictures nobody refers to can be
+      // dropped like B-frames
+      if (vcl.slice_type == 2)
+        m_FrameType = PKT_I_FRAME;
+      else if (vcl.nal_ref_idc == 0)
+        m_FrameType = PKT_B_FRAME;
+      else
+        m_FrameType = PKT_P_FRAME;
     }
 
     m_streamData.vcl_nal = vcl;
@@ -292,6 +301,7 @@ bool cParserH264::Parse_SLH(uint8_t *buf, int len, h264_private::VCL_NAL &vcl)
 
   if (slice_type > 4)
     slice_type -= 5;  /* Fixed slice type per frame */
+  vcl.slice_type = slice_type;
 
   switch (slice_type)
   {
@@ -66,6 +66,7 @@ private:
       int idr_pic_id; // slice
       int nal_unit_type;
       int nal_ref_idc; // start code
+      int slice_type; // slice
       int pic_order_cnt_type; // sps
     } vcl_nal;
 
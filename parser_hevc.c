@@ -172,6 +172,15 @@ void cParserHEVC::Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool *
         m_DTS = m_prevDTS;
         m_PTS = m_prevPTS;
       }
+
+      // IRAP pictures start a new GOP, even types below are sub-layer
+      // non-reference pictures and can be dropped like B-frames
+      if (hdr.nal_unit_type >= NAL_BLA_W_LP)
+        m_FrameType = PKT_I_FRAME;
+      else if ((hdr.nal_unit_type & 1) == 0)
+        m_FrameType = PKT_B_FRAME;
+      else
+        m_FrameType = PKT_P_FRAME;
     }
 
     m_streamData.vcl_nal = vcl;
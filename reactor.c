@@ -0,0 +1,440 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
+#include "reactor.h"
+
+#ifdef __linux__
+
+#include "config.h"
+#include "vnsiclient.h"
+#include "vnsicommand.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#define REACTOR_WORKERS 4
+#define MAX_EVENTS      64
+
+// --- cReactorWorker --------------------------------------------------------
+
+class cReactorWorker : public cThread
+{
+public:
+  cReactorWorker(cVNSIReactor &reactor, int index)
+   : m_Reactor(reactor)
+  {
+    SetDescription("VNSI worker %d", index);
+  }
+
+  /*!
+   * Let the worker end after its current request. It is not cancelled,
+   * a request may hold VDR's list locks, which a killed thread would
+   * never give back.
+   */
+  void Stop() { Cancel(-1); }
+  void Join()
+  {
+    while (Active())
+      cCondWait::SleepMs(10);
+  }
+
+protected:
+  virtual void Action(void)
+  {
+    cVNSIReactor::sJob job;
+    while (Running() && m_Reactor.NextJob(job))
+    {
+      m_Reactor.RunJob(job);
+      job.conn.reset();
+    }
+  }
+
+  cVNSIReactor &m_Reactor;
+};
+
+// --- cVNSIReactor ----------------------------------------------------------
+
+cVNSIReactor::sConnection::~sConnection()
+{
+  for (auto &req : requests)
+    delete[] req.data;
+}
+
+cVNSIReactor::cVNSIReactor()
+{
+}
+
+cVNSIReactor::~cVNSIReactor()
+{
+  Close();
+}
+
+bool cVNSIReactor::Open(int listenFd)
+{
+  m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_EpollFd < 0)
+  {
+    ERRORLOG("cVNSIReactor: epoll_create1 failed");
+    return false;
+  }
+
+  if (!AddListener(listenFd))
+  {
+    close(m_EpollFd);
+    m_EpollFd = -1;
+    return false;
+  }
+
+  m_Stopping = false;
+  for (int i = 0; i < REACTOR_WORKERS; i++)
+  {
+    m_Workers.emplace_back(new cReactorWorker(*this, i));
+    m_Workers.back()->Start();
+  }
+  return true;
+}
+
+bool cVNSIReactor::AddListener(int listenFd)
+{
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = listenFd;
+  if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0)
+  {
+    ERRORLOG("cVNSIReactor: can't add listen socket");
+    return false;
+  }
+  m_ListenFds.push_back(listenFd);
+  return true;
+}
+
+void cVNSIReactor::Close()
+{
+  {
+    cMutexLock lock(&m_Mutex);
+    m_Stopping = true;
+    m_JobsCond.Broadcast();
+  }
+  for (auto &worker : m_Workers)
+    worker->Stop();
+  for (auto &worker : m_Workers)
+    worker->Join();
+  m_Workers.clear();
+
+  {
+    cMutexLock lock(&m_Mutex);
+    for (auto &job : m_Jobs)
+    {
+      if (!job.lane)
+        delete[] job.req.data;
+    }
+    m_Jobs.clear();
+    m_Connections.clear();
+  }
+
+  if (m_EpollFd >= 0)
+  {
+    close(m_EpollFd);
+    m_EpollFd = -1;
+  }
+  m_ListenFds.clear();
+}
+
+bool cVNSIReactor::AddClient(std::shared_ptr<cVNSIClient> client, int fd)
+{
+  std::shared_ptr<sConnection> conn = std::make_shared<sConnection>();
+  conn->client = client;
+  conn->fd = fd;
+
+  cMutexLock lock(&m_Mutex);
+  m_Connections[fd] = conn;
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+  ev.data.fd = fd;
+  if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    ERRORLOG("cVNSIReactor: can't add client socket %d", fd);
+    m_Connections.erase(fd);
+    return false;
+  }
+  return true;
+}
+
+void cVNSIReactor::WakeClient(cVNSIClient *client, int fd)
+{
+  cMutexLock lock(&m_Mutex);
+  auto it = m_Connections.find(fd);
+  if (it == m_Connections.end() || it->second->client.get() != client || it->second->closing)
+    return;
+  Schedule(it->second);
+}
+
+bool cVNSIReactor::Poll(int timeout_ms)
+{
+  struct epoll_event events[MAX_EVENTS];
+
+  int n = epoll_wait(m_EpollFd, events, MAX_EVENTS, timeout_ms);
+  if (n < 0)
+  {
+    if (errno != EINTR)
+      ERRORLOG("cVNSIReactor: epoll_wait failed");
+    return false;
+  }
+
+  bool pendingAccept = false;
+  for (int i = 0; i < n; i++)
+  {
+    int fd = events[i].data.fd;
+    if (std::find(m_ListenFds.begin(), m_ListenFds.end(), fd) != m_ListenFds.end())
+    {
+      pendingAccept = true;
+      continue;
+    }
+
+    std::shared_ptr<sConnection> conn;
+    {
+      cMutexLock lock(&m_Mutex);
+      auto it = m_Connections.find(fd);
+      if (it != m_Connections.end())
+        conn = it->second;
+    }
+    if (conn)
+      ReadConnection(conn);
+  }
+  return pendingAccept;
+}
+
+void cVNSIReactor::ReadConnection(std::shared_ptr<sConnection> &conn)
+{
+  {
+    cMutexLock lock(&m_Mutex);
+    if (conn->closing)
+      return;
+  }
+
+  // edge-triggered, read until the socket is drained
+  for (;;)
+  {
+    ssize_t p = ::read(conn->fd, conn->buffer.WritePtr(), conn->buffer.WriteSpace());
+    if (p < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      ERRORLOG("cVNSIReactor: read() error on fd %d", conn->fd);
+      CloseConnection(conn);
+      return;
+    }
+    else if (p == 0)
+    {
+      INFOLOG("cVNSIReactor: eof on fd %d, connection closed", conn->fd);
+      CloseConnection(conn);
+      return;
+    }
+    conn->buffer.Written(p);
+
+    sRequest req;
+    cRequestBuffer::eResult result;
+    while ((result = conn->buffer.Next(req.requestID, req.opcode, req.data, req.dataLength)) == cRequestBuffer::REQUEST)
+    {
+      DEBUGLOG("Received chan=1, ser=%u, op=%u, edl=%u", req.requestID, req.opcode, req.dataLength);
+
+      {
+        cMutexLock lock(&m_Mutex);
+        if (conn->closing)
+        {
+          delete[] req.data;
+          return;
+        }
+        if (conn->client->IsConcurrent(req.opcode))
+        {
+          conn->inFlight++;
+          m_Jobs.push_back(sJob{conn, false, req});
+          m_JobsCond.Signal();
+        }
+        else
+        {
+          conn->requests.push_back(req);
+          Schedule(conn);
+        }
+      }
+
+      if (req.opcode == VNSI_INVALIDATESOCKET)
+      {
+        // the socket is handed over to a streamer, stop reading but keep
+        // it open
+        epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        return;
+      }
+    }
+
+    if (result == cRequestBuffer::FRAMING_ERROR)
+    {
+      CloseConnection(conn);
+      return;
+    }
+  }
+}
+
+void cVNSIReactor::CloseConnection(std::shared_ptr<sConnection> &conn)
+{
+  cMutexLock lock(&m_Mutex);
+  if (conn->closing)
+    return;
+
+  // the fd is closed along with the client, after it is forgotten here
+  conn->closing = true;
+  epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+  Schedule(conn);
+}
+
+void cVNSIReactor::Schedule(std::shared_ptr<sConnection> &conn)
+{
+  // m_Mutex is held
+  if (conn->scheduled)
+    return;
+
+  conn->scheduled = true;
+  m_Jobs.push_back(sJob{conn, true, sRequest()});
+  m_JobsCond.Signal();
+}
+
+bool cVNSIReactor::NextJob(sJob &job)
+{
+  cMutexLock lock(&m_Mutex);
+  while (m_Jobs.empty() && !m_Stopping)
+    m_JobsCond.Wait(m_Mutex);
+
+  if (m_Stopping)
+    return false;
+
+  job = m_Jobs.front();
+  m_Jobs.pop_front();
+  return true;
+}
+
+void cVNSIReactor::RunJob(sJob &job)
+{
+  std::shared_ptr<sConnection> &conn = job.conn;
+  if (job.lane)
+  {
+    RunLane(conn);
+    return;
+  }
+
+  if (!conn->client->HandleRequest(job.req.requestID, job.req.opcode, job.req.data, job.req.dataLength))
+    CloseConnection(conn);
+
+  // the last request done after the lane has finished closes
+  bool disconnect;
+  {
+    cMutexLock lock(&m_Mutex);
+    conn->inFlight--;
+    disconnect = conn->closing && !conn->scheduled && conn->inFlight == 0 && !conn->closed;
+    if (disconnect)
+      conn->closed = true;
+  }
+  if (disconnect)
+    Disconnect(conn);
+}
+
+void cVNSIReactor::RunLane(std::shared_ptr<sConnection> &conn)
+{
+  bool disconnect = false;
+  for (;;)
+  {
+    sRequest req;
+    bool flushStatus = false;
+    {
+      cMutexLock lock(&m_Mutex);
+      // stopping, the rest is dropped with the connection
+      if (m_Stopping)
+        break;
+      // status queued before WakeClient found the lane still scheduled
+      // is picked up here
+      if (conn->requests.empty() && !conn->closing && conn->client->HasPendingStatus())
+        flushStatus = true;
+      else if (conn->requests.empty())
+      {
+        conn->scheduled = false;
+        if (conn->closing && conn->inFlight == 0 && !conn->closed)
+        {
+          conn->closed = true;
+          disconnect = true;
+        }
+        break;
+      }
+      else
+      {
+        req = conn->requests.front();
+        conn->requests.pop_front();
+      }
+    }
+
+    if (flushStatus)
+    {
+      conn->client->FlushStatus();
+      continue;
+    }
+
+    if (!conn->client->HandleRequest(req.requestID, req.opcode, req.data, req.dataLength))
+    {
+      CloseConnection(conn);
+
+      // drop what was sent after
+      cMutexLock lock(&m_Mutex);
+      for (auto &r : conn->requests)
+        delete[] r.data;
+      conn->requests.clear();
+    }
+  }
+
+  if (disconnect)
+    Disconnect(conn);
+}
+
+void cVNSIReactor::Disconnect(std::shared_ptr<sConnection> &conn)
+{
+  // forget the connection before the client is removed and its fd can
+  // be reused by a new one
+  {
+    cMutexLock lock(&m_Mutex);
+    auto it = m_Connections.find(conn->fd);
+    if (it != m_Connections.end() && it->second == conn)
+      m_Connections.erase(it);
+  }
+  conn->client->Disconnected();
+}
+
+#endif
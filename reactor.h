@@ -0,0 +1,131 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#ifdef __linux__
+
+#include <vdr/thread.h>
+
+#include "requestpacket.h"
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+class cVNSIClient;
+class cReactorWorker;
+
+/*!
+ * Reads the control connections of all clients from one edge-triggered
+ * epoll set and hands complete requests to a small pool of workers.
+ * Requests of one connection are processed in order, by one worker at a
+ * time, except for those the client allows to be answered out of order:
+ * they are queued as jobs of their own. The thread count does not depend on the number of clients, only
+ * streamers keep threads of their own.
+ */
+class cVNSIReactor
+{
+  friend class cReactorWorker;
+public:
+  cVNSIReactor();
+  virtual ~cVNSIReactor();
+
+  cVNSIReactor(const cVNSIReactor &) = delete;
+  cVNSIReactor &operator=(const cVNSIReactor &) = delete;
+
+  bool Open(int listenFd);
+  /*!
+   * Watch another listen socket, reported by Poll() like the first one.
+   */
+  bool AddListener(int listenFd);
+  void Close();
+  bool AddClient(std::shared_ptr<cVNSIClient> client, int fd);
+
+  /*!
+   * Let a worker send the queued status messages of the client, in the
+   * lane of its connection.
+   */
+  void WakeClient(cVNSIClient *client, int fd);
+
+  /*!
+   * Wait for and read from the connections. Returns true if new
+   * connections are waiting on one of the listen sockets.
+   */
+  bool Poll(int timeout_ms);
+
+protected:
+  struct sRequest
+  {
+    uint32_t requestID;
+    uint32_t opcode;
+    uint8_t *data;
+    uint32_t dataLength;
+  };
+
+  struct sConnection
+  {
+    ~sConnection();
+
+    std::shared_ptr<cVNSIClient> client;
+    int fd;
+    cRequestBuffer buffer;
+    std::deque<sRequest> requests;
+    bool scheduled = false;                      /*!> Queued to or run by a worker */
+    int inFlight = 0;                            /*!> Concurrent requests not done yet */
+    bool closing = false;
+    bool closed = false;
+  };
+
+  /*!
+   * Work for a worker: either the ordered lane of a connection, or a
+   * single request that may complete out of order.
+   */
+  struct sJob
+  {
+    std::shared_ptr<sConnection> conn;
+    bool lane;
+    sRequest req;
+  };
+
+  void ReadConnection(std::shared_ptr<sConnection> &conn);
+  void CloseConnection(std::shared_ptr<sConnection> &conn);
+  void Schedule(std::shared_ptr<sConnection> &conn);
+  bool NextJob(sJob &job);
+  void RunJob(sJob &job);
+  void RunLane(std::shared_ptr<sConnection> &conn);
+  void Disconnect(std::shared_ptr<sConnection> &conn);
+
+  int m_EpollFd = -1;
+  std::vector<int> m_ListenFds;
+  cMutex m_Mutex;
+  cCondVar m_JobsCond;
+  bool m_Stopping = false;
+  std::map<int, std::shared_ptr<sConnection>> m_Connections;
+  std::deque<sJob> m_Jobs;
+  std::vector<std::unique_ptr<cReactorWorker>> m_Workers;
+};
+
+#endif
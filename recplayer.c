@@ -188,7 +188,7 @@ double cRecPlayer::getFPS()
   return m_fps;
 }
 
-int cRecPlayer::getBlock(unsigned char* buffer, uint64_t position, int amount)
+int cRecPlayer::findBlock(uint64_t position, int amount, uint64_t &filePosition)
 {
   // dont let the block be larger than 256 kb
   if (amount > 512*1024)
@@ -228,7 +228,27 @@ int cRecPlayer::getBlock(unsigned char* buffer, uint64_t position, int amount)
     return 0;
 
   // work out position in current file
-  uint64_t filePosition = position - segmentIterator->start;
+  filePosition = position - segmentIterator->start;
+  return amount;
+}
+
+void cRecPlayer::releaseBlock(uint64_t filePosition, int amount)
+{
+  if (!m_inProgress)
+  {
+#ifndef __FreeBSD__
+    // Tell linux not to bother keeping the data in the FS cache
+    posix_fadvise(m_file, filePosition, amount, POSIX_FADV_DONTNEED);
+#endif
+  }
+}
+
+int cRecPlayer::getBlock(unsigned char* buffer, uint64_t position, int amount)
+{
+  uint64_t filePosition;
+  amount = findBlock(position, amount, filePosition);
+  if (amount <= 0)
+    return 0;
 
   // seek to position
   if(lseek(m_file, filePosition, SEEK_SET) == -1)
@@ -249,15 +269,36 @@ int cRecPlayer::getBlock(unsigned char* buffer, uint64_t position, int amount)
     return 0;
   }
 
-  if (!m_inProgress)
+  releaseBlock(filePosition, bytes_read);
+
+  return bytes_read;
+}
+
+int cRecPlayer::getBlockFile(uint64_t position, int amount, int &fd, uint64_t &filePosition)
+{
+  amount = findBlock(position, amount, filePosition);
+  if (amount <= 0)
+    return 0;
+
+  // the span ends with the segment file, the client asks for the rest
+  struct stat st;
+  if (fstat(m_file, &st) == -1)
   {
-#ifndef __FreeBSD__
-    // Tell linux not to bother keeping the data in the FS cache
-    posix_fadvise(m_file, filePosition, bytes_read, POSIX_FADV_DONTNEED);
-#endif
+    ERRORLOG("unable to stat %s", m_fileName);
+    return 0;
   }
+  if (filePosition >= (uint64_t)st.st_size)
+  {
+    // we may got stuck at end of segment
+    if (position < m_totalLength)
+      return getBlockFile(position+1, amount, fd, filePosition);
+    return 0;
+  }
+  if (filePosition + amount > (uint64_t)st.st_size)
+    amount = st.st_size - filePosition;
 
-  return bytes_read;
+  fd = m_file;
+  return amount;
 }
 
 uint64_t cRecPlayer::positionFromFrameNumber(uint32_t frameNumber)
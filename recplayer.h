@@ -55,6 +55,13 @@ public:
   uint32_t getLengthFrames();
   double getFPS();
   int getBlock(unsigned char* buffer, uint64_t position, int amount);
+  /*!
+   * Locate a block for sending it straight from the file: returns the
+   * number of bytes available at filePosition of fd, which may be less
+   * than amount at the end of a segment. Call releaseBlock() once sent.
+   */
+  int getBlockFile(uint64_t position, int amount, int &fd, uint64_t &filePosition);
+  void releaseBlock(uint64_t filePosition, int amount);
 
   bool openFile(int index);
   void closeFile();
@@ -67,6 +74,7 @@ public:
 
 private:
   void cleanup();
+  int findBlock(uint64_t position, int amount, uint64_t &filePosition);
   char* fileNameFromIndex(int index);
   void checkBufferSize(int s);
 
@@ -0,0 +1,156 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "recpusher.h"
+#include "config.h"
+#include "cxsocket.h"
+#include "pacer.h"
+#include "recplayer.h"
+#include "responsepacket.h"
+
+#define PUSH_BLOCK_SIZE (256*1024)
+#define IDLE_WAIT_MS    1000
+
+cRecPusher::cRecPusher(cxSocket &socket, const cRecording *recording, cPacer *pacer)
+ : m_Socket(socket)
+ , m_Pacer(pacer)
+{
+  m_RecPlayer = new cRecPlayer(recording);
+  SetDescription("VNSI recording pusher");
+}
+
+cRecPusher::~cRecPusher()
+{
+  Stop();
+  delete m_RecPlayer;
+}
+
+uint32_t cRecPusher::Start(uint64_t position, uint32_t credit)
+{
+  uint32_t serial = Seek(position, credit);
+  cThread::Start();
+  return serial;
+}
+
+void cRecPusher::AddCredit(uint32_t bytes)
+{
+  cMutexLock lock(&m_Mutex);
+  m_Credit += bytes;
+  m_Cond.Broadcast();
+}
+
+uint32_t cRecPusher::Seek(uint64_t position, uint32_t credit)
+{
+  cMutexLock lock(&m_Mutex);
+  m_Position = position;
+  m_Credit = credit;
+  m_Serial++;
+  m_EndSent = false;
+  m_Cond.Broadcast();
+  return m_Serial;
+}
+
+void cRecPusher::Stop()
+{
+  {
+    cMutexLock lock(&m_Mutex);
+    Cancel(-1);
+    m_Cond.Broadcast();
+  }
+  Cancel(5);
+}
+
+void cRecPusher::Action(void)
+{
+  cResponsePacket resp;
+
+  while (Running())
+  {
+    uint64_t position;
+    uint32_t serial;
+    int amount;
+    {
+      cMutexLock lock(&m_Mutex);
+      if (m_Credit == 0)
+      {
+        m_Cond.TimedWait(m_Mutex, IDLE_WAIT_MS);
+        continue;
+      }
+      position = m_Position;
+      serial = m_Serial;
+      amount = m_Credit < PUSH_BLOCK_SIZE ? m_Credit : PUSH_BLOCK_SIZE;
+    }
+
+    int fd;
+    uint64_t filePosition;
+    int length = m_RecPlayer->getBlockFile(position, amount, fd, filePosition);
+    if (length <= 0)
+    {
+      // an empty block marks the end, the recording may still grow though
+      bool sendEnd;
+      {
+        cMutexLock lock(&m_Mutex);
+        // a seek meanwhile needs the end for its own serial
+        sendEnd = !m_EndSent && serial == m_Serial;
+        if (serial == m_Serial)
+        {
+          if (!sendEnd)
+            m_Cond.TimedWait(m_Mutex, IDLE_WAIT_MS);
+          m_EndSent = true;
+        }
+      }
+      if (sendEnd)
+      {
+        resp.initRecStream(serial, position);
+        resp.finaliseRecStream();
+        if (m_Socket.write(resp.getPtr(), resp.getLen()) != (ssize_t)resp.getLen())
+          break;
+      }
+      continue;
+    }
+
+    uint32_t headerLength;
+    resp.initRecStream(serial, position);
+    headerLength = resp.getLen();
+    resp.setLen(headerLength + length);
+    resp.finaliseRecStream();
+    if (m_Pacer)
+      m_Pacer->Wait(resp.getLen());
+    if (m_Socket.sendfile(resp.getPtr(), headerLength, fd, filePosition, length) != length)
+    {
+      ERRORLOG("cRecPusher: failed to send %d bytes", length);
+      m_Socket.Shutdown();
+      break;
+    }
+    m_RecPlayer->releaseBlock(filePosition, length);
+
+    cMutexLock lock(&m_Mutex);
+    if (serial == m_Serial)
+    {
+      m_Position += length;
+      m_Credit -= length;
+      m_EndSent = false;
+    }
+  }
+}
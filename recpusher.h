@@ -0,0 +1,70 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <vdr/thread.h>
+
+#include <stdint.h>
+
+class cxSocket;
+class cRecording;
+class cRecPlayer;
+class cPacer;
+
+/*!
+ * Pushes the blocks of a recording to the client without waiting for a
+ * request per block. The client bounds what is in flight by granting byte
+ * credits as it consumes the data. A seek flushes the pipeline: it starts
+ * a new serial, blocks still arriving with an older one are discarded by
+ * the client. Reads from a player of its own, so the requests served by
+ * the client's player don't have to be synchronised with it.
+ */
+class cRecPusher : public cThread
+{
+public:
+  cRecPusher(cxSocket &socket, const cRecording *recording, cPacer *pacer);
+  virtual ~cRecPusher();
+
+  cRecPusher(const cRecPusher &) = delete;
+  cRecPusher &operator=(const cRecPusher &) = delete;
+
+  uint32_t Start(uint64_t position, uint32_t credit);
+  void AddCredit(uint32_t bytes);
+  uint32_t Seek(uint64_t position, uint32_t credit);
+  void Stop();
+
+protected:
+  virtual void Action(void);
+
+  cxSocket &m_Socket;
+  cPacer *m_Pacer;
+  cRecPlayer *m_RecPlayer;
+  cMutex m_Mutex;
+  cCondVar m_Cond;
+  uint64_t m_Position = 0;
+  uint64_t m_Credit = 0;
+  uint32_t m_Serial = 0;
+  bool m_EndSent = false;                        /*!> End of recording signalled for this serial */
+};
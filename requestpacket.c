@@ -30,6 +30,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <arpa/inet.h>
+
+#include <new>
 
 #ifndef __FreeBSD__
 #include <asm/byteorder.h>
@@ -141,3 +144,96 @@ uint8_t* cRequestPacket::getData()
 {
   return userData;
 }
+
+// --- cRequestBuffer --------------------------------------------------------
+
+cRequestBuffer::cRequestBuffer()
+{
+  m_Buffer = (uint8_t*)malloc(INITIAL_SIZE);
+  m_Size = m_Buffer ? INITIAL_SIZE : 0;
+}
+
+cRequestBuffer::~cRequestBuffer()
+{
+  free(m_Buffer);
+}
+
+bool cRequestBuffer::Reserve(size_t bytes)
+{
+  // move the unparsed rest to the front, then grow if still too small
+  if (m_Start)
+  {
+    memmove(m_Buffer, m_Buffer + m_Start, m_Fill - m_Start);
+    m_Fill -= m_Start;
+    m_Start = 0;
+  }
+
+  if (bytes <= m_Size)
+    return true;
+
+  uint8_t *buffer = (uint8_t*)realloc(m_Buffer, bytes);
+  if (!buffer)
+    return false;
+  m_Buffer = buffer;
+  m_Size = bytes;
+  return true;
+}
+
+cRequestBuffer::eResult cRequestBuffer::Next(uint32_t &requestID, uint32_t &opcode, uint8_t *&data, uint32_t &dataLength)
+{
+  size_t available = m_Fill - m_Start;
+  if (available < HEADER_SIZE)
+  {
+    if (!Reserve(HEADER_SIZE))
+    {
+      ERRORLOG("Receive buffer malloc error");
+      return FRAMING_ERROR;
+    }
+    return NEED_MORE;
+  }
+
+  uint32_t header[4];
+  memcpy(header, m_Buffer + m_Start, HEADER_SIZE);
+  if (ntohl(header[0]) != 1)
+  {
+    ERRORLOG("Incoming channel number unknown");
+    return FRAMING_ERROR;
+  }
+
+  dataLength = ntohl(header[3]);
+  if (dataLength > MAX_DATA_LENGTH)
+  {
+    ERRORLOG("dataLength > %u!", MAX_DATA_LENGTH);
+    return FRAMING_ERROR;
+  }
+
+  if (available < HEADER_SIZE + dataLength)
+  {
+    // make room for the whole frame
+    if (!Reserve(HEADER_SIZE + dataLength))
+    {
+      ERRORLOG("Receive buffer malloc error");
+      return FRAMING_ERROR;
+    }
+    return NEED_MORE;
+  }
+
+  requestID = ntohl(header[1]);
+  opcode = ntohl(header[2]);
+  data = NULL;
+  if (dataLength)
+  {
+    data = new (std::nothrow) uint8_t[dataLength];
+    if (!data)
+    {
+      ERRORLOG("Extra data buffer malloc error");
+      return FRAMING_ERROR;
+    }
+    memcpy(data, m_Buffer + m_Start + HEADER_SIZE, dataLength);
+  }
+
+  m_Start += HEADER_SIZE + dataLength;
+  if (m_Start == m_Fill)
+    m_Start = m_Fill = 0;
+  return REQUEST;
+}
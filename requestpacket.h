@@ -78,4 +78,52 @@ private:
   uint32_t flag; // stream only
 };
 
+/*!
+ * Receive buffer of a control connection. The socket is read into it as
+ * far as data is available, then all complete request frames are taken
+ * out of it, so a burst of requests costs a read or two instead of
+ * several per request.
+ */
+class cRequestBuffer
+{
+public:
+  cRequestBuffer();
+  ~cRequestBuffer();
+
+  cRequestBuffer(const cRequestBuffer &) = delete;
+  cRequestBuffer &operator=(const cRequestBuffer &) = delete;
+
+  enum eResult
+  {
+    NEED_MORE,
+    REQUEST,
+    FRAMING_ERROR
+  };
+
+  /*!
+   * Free space to read into, never empty.
+   */
+  uint8_t *WritePtr() { return m_Buffer + m_Fill; }
+  size_t WriteSpace() const { return m_Size - m_Fill; }
+  void Written(size_t bytes) { m_Fill += bytes; }
+
+  /*!
+   * Take the next complete request out of the buffer. data is allocated
+   * with new[] and becomes the caller's, as cRequestPacket expects it.
+   */
+  eResult Next(uint32_t &requestID, uint32_t &opcode, uint8_t *&data, uint32_t &dataLength);
+
+private:
+  static const size_t HEADER_SIZE = 16;
+  static const size_t INITIAL_SIZE = 16*1024;
+  static const uint32_t MAX_DATA_LENGTH = 200000; // a random sanity limit
+
+  bool Reserve(size_t bytes);
+
+  uint8_t *m_Buffer;
+  size_t m_Size;
+  size_t m_Start = 0;                            /*!> First byte not yet parsed */
+  size_t m_Fill = 0;
+};
+
 #endif // VNSI_REQUESTPACKET_H
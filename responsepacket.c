@@ -28,6 +28,12 @@
  * This code is taken from VOMP for VDR plugin.
  */
 
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
 #include "responsepacket.h"
 #include "vnsicommand.h"
 #include "config.h"
@@ -35,6 +41,8 @@
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+#include <atomic>
 
 #ifndef __FreeBSD__
 #include <asm/byteorder.h>
@@ -52,6 +60,66 @@
 ? bytes = rest of packet. depends on packet
 */
 
+#define MIN_BUFFER_SIZE   512
+#define MAX_SPARE_SIZE    (2*1024*1024)
+#define SMALL_SPARE_SIZE  (64*1024)        // kept by any thread
+#define MAX_SPARE_TOTAL   (8*1024*1024)    // larger ones, all threads together
+
+namespace
+{
+// bytes held in spare buffers above SMALL_SPARE_SIZE
+std::atomic<uint32_t> spareTotal(0);
+
+uint32_t SpareCost(uint32_t size)
+{
+  return size > SMALL_SPARE_SIZE ? size : 0;
+}
+
+bool ReserveSpare(uint32_t cost)
+{
+  uint32_t total = spareTotal;
+  do
+  {
+    if (total + cost > MAX_SPARE_TOTAL)
+      return false;
+  } while (!spareTotal.compare_exchange_weak(total, total + cost));
+  return true;
+}
+
+struct sSpareBuffer
+{
+  ~sSpareBuffer() { Take(); free(buffer); }
+
+  // hand out the buffer, it no longer counts as spare
+  uint8_t *Take()
+  {
+    uint8_t *b = buffer;
+    spareTotal -= SpareCost(size);
+    buffer = NULL;
+    size = 0;
+    return b;
+  }
+
+  uint8_t *buffer = NULL;
+  uint32_t size = 0;
+};
+
+thread_local sSpareBuffer spare;
+thread_local uint32_t sizeHint = 0;
+thread_local uint32_t highWater = 0;
+}
+
+void cResponsePacket::SetSizeHint(uint32_t size)
+{
+  sizeHint = size;
+  highWater = 0;
+}
+
+uint32_t cResponsePacket::GetHighWater()
+{
+  return highWater;
+}
+
 cResponsePacket::cResponsePacket()
 {
   buffer = NULL;
@@ -61,13 +129,40 @@ cResponsePacket::cResponsePacket()
 
 cResponsePacket::~cResponsePacket()
 {
-  if (buffer) free(buffer);
+  if (!buffer)
+    return;
+
+  // packets sent from a file are longer than their buffer
+  uint32_t used = bufUsed < bufSize ? bufUsed : bufSize;
+  if (used > highWater)
+    highWater = used;
+
+  // each thread keeps its largest buffer, but large ones only while
+  // the threads together stay below MAX_SPARE_TOTAL
+  if (bufSize <= MAX_SPARE_SIZE && bufSize > spare.size && ReserveSpare(SpareCost(bufSize)))
+  {
+    free(spare.Take());
+    spare.buffer = buffer;
+    spare.size = bufSize;
+  }
+  else
+    free(buffer);
 }
 
 void cResponsePacket::initBuffers()
 {
   if (buffer == NULL) {
-    bufSize = 512;
+    uint32_t size = sizeHint > MIN_BUFFER_SIZE ? sizeHint : MIN_BUFFER_SIZE;
+    sizeHint = 0;
+
+    if (spare.buffer) {
+      bufSize = spare.size;
+      buffer = spare.Take();
+      if (bufSize >= size)
+        return;
+      free(buffer);
+    }
+    bufSize = size;
     buffer = (uint8_t*)malloc(bufSize);
   }
 }
@@ -176,6 +271,43 @@ void cResponsePacket::initOsd(uint32_t opCode, int32_t wnd, int32_t color, int32
   bufUsed = headerLengthOSD;
 }
 
+void cResponsePacket::initRecStream(uint32_t serial, uint64_t position)
+{
+  initBuffers();
+
+  uint32_t ul;
+  uint64_t ull;
+
+  ul =  htonl(VNSI_CHANNEL_RECSTREAM);         // pushed recording
+  memcpy(&buffer[0], &ul, sizeof(uint32_t));
+  ul = htonl(serial);                          // Seek serial
+  memcpy(&buffer[4], &ul, sizeof(uint32_t));
+  ull = __cpu_to_be64(position);               // Position in the recording
+  memcpy(&buffer[8], &ull, sizeof(uint64_t));
+  ul = 0;
+  memcpy(&buffer[userDataLenPosRecStream], &ul, sizeof(uint32_t));
+
+  bufUsed = headerLengthRecStream;
+}
+
+void cResponsePacket::initCompressed(uint32_t requestID, uint32_t uncompressedLength)
+{
+  initBuffers();
+
+  uint32_t ul;
+
+  ul = htonl(VNSI_CHANNEL_COMPRESSED);         // compressed RR channel
+  memcpy(&buffer[0], &ul, sizeof(uint32_t));
+  ul = htonl(requestID);
+  memcpy(&buffer[4], &ul, sizeof(uint32_t));
+  ul = 0;
+  memcpy(&buffer[userDataLenPosCompressed], &ul, sizeof(uint32_t));
+  ul = htonl(uncompressedLength);              // Length once inflated
+  memcpy(&buffer[12], &ul, sizeof(uint32_t));
+
+  bufUsed = headerLengthCompressed;
+}
+
 void cResponsePacket::finalise()
 {
   uint32_t ul = htonl(bufUsed - headerLength);
@@ -194,6 +326,38 @@ void cResponsePacket::finaliseOSD()
   memcpy(&buffer[userDataLenPosOSD], &ul, sizeof(uint32_t));
 }
 
+void cResponsePacket::finaliseRecStream()
+{
+  uint32_t ul = htonl(bufUsed - headerLengthRecStream);
+  memcpy(&buffer[userDataLenPosRecStream], &ul, sizeof(uint32_t));
+}
+
+void cResponsePacket::finaliseCompressed()
+{
+  uint32_t ul = htonl(bufUsed - headerLengthCompressed);
+  memcpy(&buffer[userDataLenPosCompressed], &ul, sizeof(uint32_t));
+}
+
+bool cResponsePacket::compress(cResponsePacket &out, int level)
+{
+  uint32_t requestID;
+  memcpy(&requestID, &buffer[4], sizeof(uint32_t));
+  requestID = ntohl(requestID);
+
+  uint32_t length = bufUsed - headerLength;
+  out.initCompressed(requestID, length);
+
+  uLongf size = compressBound(length);
+  uint8_t* p = out.reserve(size);
+  if (!p)
+    return false;
+  if (compress2(p, &size, buffer + headerLength, length, level) != Z_OK)
+    return false;
+  out.unreserve(compressBound(length) - size);
+  out.finaliseCompressed();
+  return true;
+}
+
 bool cResponsePacket::copyin(const uint8_t* src, uint32_t len)
 {
   if (!checkExtend(len)) return false;
@@ -274,10 +438,12 @@ bool cResponsePacket::add_double(double d)
 bool cResponsePacket::checkExtend(uint32_t by)
 {
   if ((bufUsed + by) < bufSize) return true;
-  if (512 > by) by = 512;
-  uint8_t* newBuf = (uint8_t*)realloc(buffer, bufSize + by);
+  uint32_t newSize = bufSize * 2;
+  if (newSize < MIN_BUFFER_SIZE) newSize = MIN_BUFFER_SIZE;
+  if (newSize <= bufUsed + by) newSize = bufUsed + by + 1;
+  uint8_t* newBuf = (uint8_t*)realloc(buffer, newSize);
   if (!newBuf) return false;
   buffer = newBuf;
-  bufSize += by;
+  bufSize = newSize;
   return true;
 }
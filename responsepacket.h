@@ -44,9 +44,18 @@ public:
   void initStatus(uint32_t opCode);
   void initStream(uint32_t opCode, uint32_t streamID, uint32_t duration, int64_t pts, int64_t dts, uint32_t serial);
   void initOsd(uint32_t opCode, int32_t wnd, int32_t color, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+  void initRecStream(uint32_t serial, uint64_t position);
+  void initCompressed(uint32_t requestID, uint32_t uncompressedLength);
   void finalise();
   void finaliseStream();
   void finaliseOSD();
+  void finaliseRecStream();
+  void finaliseCompressed();
+  /*!
+   * Deflate a finalised response into out, as a VNSI_CHANNEL_COMPRESSED
+   * packet with the same request ID.
+   */
+  bool compress(cResponsePacket &out, int level);
   bool copyin(const uint8_t* src, uint32_t len);
   uint8_t* reserve(uint32_t len);
   bool unreserve(uint32_t len);
@@ -62,8 +71,19 @@ public:
   uint32_t getLen() { return bufUsed; }
   uint32_t getStreamHeaderLength() { return headerLengthStream; } ;
   uint32_t getOSDHeaderLength() { return headerLengthOSD; } ;
+  uint32_t getRecStreamHeaderLength() { return headerLengthRecStream; } ;
+  uint32_t getHeaderLength() { return headerLength; } ;
   void     setLen(uint32_t len) { bufUsed = len; }
 
+  /*!
+   * The buffer of a packet is kept by its thread when the packet is
+   * destroyed and taken by the next one built there. The hint sizes the
+   * buffer of the next packet of the calling thread, GetHighWater()
+   * returns the largest packet it built since then.
+   */
+  static void SetSizeHint(uint32_t size);
+  static uint32_t GetHighWater();
+
 private:
   uint8_t* buffer;
   uint32_t bufSize;
@@ -78,6 +98,10 @@ private:
   const static uint32_t userDataLenPosStream  = 36;
   const static uint32_t headerLengthOSD       = 36;
   const static uint32_t userDataLenPosOSD     = 32;
+  const static uint32_t headerLengthRecStream   = 20;
+  const static uint32_t userDataLenPosRecStream = 16;
+  const static uint32_t headerLengthCompressed  = 16;
+  const static uint32_t userDataLenPosCompressed = 8;
 };
 
 #endif // VNSI_RESPONSEPACKET_H
@@ -0,0 +1,196 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// work-around for VDR's tools.h
+#if VDRVERSNUM < 20400
+#define __STL_CONFIG_H 1
+#else
+#define DISABLE_TEMPLATES_COLLIDING_WITH_STL 1
+#endif
+#include "shmring.h"
+
+#ifdef __linux__
+
+#include "config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+cShmRing::cShmRing()
+{
+}
+
+cShmRing::~cShmRing()
+{
+  Close();
+}
+
+bool cShmRing::Open(size_t size)
+{
+  // the data is a whole number of pages
+  size = (size + HEADER_SIZE - 1) & ~(HEADER_SIZE - 1);
+
+#ifdef SYS_memfd_create
+  m_MemFd = syscall(SYS_memfd_create, "vnsi-stream", MFD_CLOEXEC);
+#endif
+  if (m_MemFd < 0)
+  {
+    ERRORLOG("cShmRing: memfd_create failed");
+    return false;
+  }
+
+  if (ftruncate(m_MemFd, HEADER_SIZE + size) < 0)
+  {
+    ERRORLOG("cShmRing: can't size the ring to %zu bytes", size);
+    Close();
+    return false;
+  }
+
+  void *map = mmap(NULL, HEADER_SIZE + size, PROT_READ | PROT_WRITE, MAP_SHARED, m_MemFd, 0);
+  if (map == MAP_FAILED)
+  {
+    ERRORLOG("cShmRing: mmap failed");
+    Close();
+    return false;
+  }
+  m_Map = (uint8_t*)map;
+  m_Size = size;
+
+  m_DataFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  m_SpaceFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (m_DataFd < 0 || m_SpaceFd < 0)
+  {
+    ERRORLOG("cShmRing: eventfd failed");
+    Close();
+    return false;
+  }
+
+  m_Header = new (m_Map) sHeader;
+  m_Header->magic = MAGIC;
+  m_Header->version = VERSION;
+  m_Header->size = m_Size;
+  m_Header->head = 0;
+  m_Header->tail = 0;
+  m_Header->readerWaiting = 0;
+  m_Header->writerWaiting = 0;
+  return true;
+}
+
+void cShmRing::Close()
+{
+  if (m_Map)
+  {
+    munmap(m_Map, HEADER_SIZE + m_Size);
+    m_Map = nullptr;
+    m_Header = nullptr;
+  }
+  m_Size = 0;
+
+  if (m_MemFd >= 0)
+    close(m_MemFd);
+  if (m_DataFd >= 0)
+    close(m_DataFd);
+  if (m_SpaceFd >= 0)
+    close(m_SpaceFd);
+  m_MemFd = m_DataFd = m_SpaceFd = -1;
+}
+
+ssize_t cShmRing::Write(const struct iovec *iov, int iovcnt, int timeout_ms)
+{
+  size_t size = 0;
+  for (int i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
+  if (size > m_Size)
+    return -1;
+
+  uint64_t head = m_Header->head.load(std::memory_order_relaxed);
+  while (m_Size - (head - m_Header->tail.load()) < size)
+  {
+    // announce the wait, then check again before sleeping, the client
+    // rings after it moved the tail
+    m_Header->writerWaiting = 1;
+    if (m_Size - (head - m_Header->tail.load()) >= size)
+    {
+      m_Header->writerWaiting = 0;
+      break;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = m_SpaceFd;
+    pfd.events = POLLIN;
+    int r = poll(&pfd, 1, timeout_ms);
+    m_Header->writerWaiting = 0;
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return 0;
+
+    uint64_t value;
+    if (read(m_SpaceFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+      return 0;
+  }
+
+  uint8_t *data = m_Map + HEADER_SIZE;
+  size_t offset = head % m_Size;
+  for (int i = 0; i < iovcnt; i++)
+  {
+    const uint8_t *src = (const uint8_t*)iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+    while (len > 0)
+    {
+      size_t chunk = m_Size - offset;
+      if (chunk > len)
+        chunk = len;
+      memcpy(data + offset, src, chunk);
+      src += chunk;
+      len -= chunk;
+      offset = (offset + chunk) % m_Size;
+    }
+  }
+
+  m_Header->head.store(head + size);
+  return size;
+}
+
+void cShmRing::Notify()
+{
+  if (m_Header && m_Header->readerWaiting.load())
+  {
+    uint64_t value = 1;
+    if (write(m_DataFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+      ERRORLOG("cShmRing: can't ring the data doorbell");
+  }
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#ifdef __linux__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <sys/uio.h>
+
+/*!
+ * Byte ring in a memfd shared with a client on this host. The server
+ * writes stream packets into it exactly as it would write them to the
+ * socket, the client maps the memfd and reads them in place. Two eventfds
+ * are the doorbells: the data one wakes a client waiting for packets, the
+ * space one wakes the server waiting for the client to consume.
+ */
+class cShmRing
+{
+public:
+  /*!
+   * Layout of the first page of the memfd, followed by the data. Positions
+   * are the total bytes written and consumed, an offset into the data is
+   * the position modulo its size.
+   */
+  struct sHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;                               /*!> Bytes of data */
+    std::atomic<uint64_t> head;                  /*!> Written by the server */
+    std::atomic<uint64_t> tail;                  /*!> Written by the client */
+    std::atomic<uint32_t> readerWaiting;         /*!> Client sleeps on the data eventfd */
+    std::atomic<uint32_t> writerWaiting;         /*!> Server sleeps on the space eventfd */
+  };
+
+  static const uint32_t MAGIC = 0x564e5352;      /*!> "VNSR" */
+  static const uint32_t VERSION = 1;
+  static const size_t HEADER_SIZE = 4096;
+
+  cShmRing();
+  virtual ~cShmRing();
+
+  cShmRing(const cShmRing &) = delete;
+  cShmRing &operator=(const cShmRing &) = delete;
+
+  bool Open(size_t size);
+  void Close();
+  int GetMemFd() { return m_MemFd; }
+  int GetDataFd() { return m_DataFd; }
+  int GetSpaceFd() { return m_SpaceFd; }
+  size_t GetSize() { return m_Size; }
+
+  /*!
+   * Copy the buffers into the ring in one piece, waiting up to timeout_ms
+   * for the space. Returns the bytes written, 0 on timeout and -1 if they
+   * can never fit.
+   */
+  ssize_t Write(const struct iovec *iov, int iovcnt, int timeout_ms);
+
+  /*!
+   * Ring the data doorbell if the client waits for it.
+   */
+  void Notify();
+
+protected:
+  int m_MemFd = -1;
+  int m_DataFd = -1;
+  int m_SpaceFd = -1;
+  size_t m_Size = 0;
+  uint8_t *m_Map = nullptr;
+  sHeader *m_Header = nullptr;
+};
+
+#endif
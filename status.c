@@ -36,6 +36,8 @@
 #include <errno.h>
 #include <string.h>
 
+#include <string>
+
 cVNSIStatus::cVNSIStatus() : cThread("VNSIStatus")
 {
 }
@@ -94,11 +96,47 @@ static void DeleteFiles(const char *directory_path, const char *suffix)
   closedir(dir);
 }
 
-void cVNSIStatus::AddClient(int fd, unsigned int id, const char *ClientAdr, CVNSITimers &timers)
+std::shared_ptr<cVNSIClient> cVNSIStatus::AddClient(int fd, unsigned int id, const char *ClientAdr, CVNSITimers &timers)
 {
   cMutexLock lock(&m_mutex);
   std::shared_ptr<cVNSIClient> client = std::make_shared<cVNSIClient>(fd, id, ClientAdr, timers);
   m_clients.push_back(client);
+  return client;
+}
+
+int cVNSIStatus::GetClientCount()
+{
+  // disconnected ones are removed a little later, they don't count
+  int count = 0;
+  cMutexLock lock(&m_mutex);
+  for (auto &client : m_clients)
+  {
+    if (client->IsActive())
+      count++;
+  }
+  return count;
+}
+
+cString cVNSIStatus::GetStats()
+{
+  // the clients are asked without holding m_mutex, the references keep
+  // them alive
+  std::list<std::shared_ptr<cVNSIClient>> clients;
+  {
+    cMutexLock lock(&m_mutex);
+    clients = m_clients;
+  }
+
+  std::string stats;
+  for (auto &client : clients)
+  {
+    if (!stats.empty())
+      stats += "\n";
+    stats += *client->GetStats();
+  }
+  if (stats.empty())
+    return "no clients connected";
+  return stats.c_str();
 }
 
 void cVNSIStatus::Action(void)
@@ -173,7 +211,7 @@ void cVNSIStatus::Action(void)
     // remove disconnected clients
     for (auto i = m_clients.begin(); i != m_clients.end();)
     {
-      if (!(*i)->Active())
+      if (!(*i)->IsActive())
       {
         INFOLOG("removing client with ID %u from client list", (*i)->GetID());
         i = m_clients.erase(i);
@@ -44,7 +44,9 @@ public:
   void Init(CVNSITimers *timers);
   void Shutdown();
 
-  void AddClient(int fd, unsigned int id, const char *ClientAdr, CVNSITimers &timers);
+  std::shared_ptr<cVNSIClient> AddClient(int fd, unsigned int id, const char *ClientAdr, CVNSITimers &timers);
+  cString GetStats();
+  int GetClientCount();
 
 protected:
   virtual void Action(void);
@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <arpa/inet.h>
 #include <time.h>
 
 // work-around for VDR's tools.h
@@ -39,27 +40,39 @@
 #include "cxsocket.h"
 #include "vnsicommand.h"
 #include "responsepacket.h"
+#include "shmring.h"
+#include "pacer.h"
 #include "vnsi.h"
-#include "videobuffer.h"
 
 #include <vdr/channels.h>
 #include <vdr/eitscan.h>
 
+#include <algorithm>
+
+// queue limits between demux stage and sender, a client falling this
+// far behind a shared demuxer detaches into its own buffer
+#define QUEUE_BYTES  (8*1024*1024)
+#define QUEUE_FRAMES 1024
+
 // --- cLiveStreamer -------------------------------------------------
 
 cLiveStreamer::cLiveStreamer(int clientID, bool bAllowRDS, int protocol, uint8_t timeshift, uint32_t timeout)
  : cThread("cLiveStreamer stream processor")
  , m_ClientID(clientID)
  , m_scanTimeout(timeout)
- , m_Demuxer(bAllowRDS)
- , m_VideoInput(m_Event)
+ , m_AllowRDS(bAllowRDS)
+ , m_Queue(m_Event, QUEUE_BYTES, QUEUE_FRAMES)
 {
   m_protocolVersion = protocol;
+  m_Compact = protocol >= VNSI_COMPACT_PROTOCOLVERSION;
+  resetCompact();
   m_Timeshift = timeshift;
   m_refTime = -1;
   m_refDTS = -2;
 
   memset(&m_FrontendInfo, 0, sizeof(m_FrontendInfo));
+  m_SignalDevice[0] = 0;
+  m_SendStatus = false;
 
   if(m_scanTimeout == 0)
     m_scanTimeout = VNSIServerConfig.stream_timeout;
@@ -69,7 +82,7 @@ cLiveStreamer::~cLiveStreamer()
 {
   DEBUGLOG("Started to delete live streamer");
 
-  Cancel(5);
+  Activate(false);
   Close();
 
   DEBUGLOG("Finished to delete live streamer");
@@ -79,88 +92,27 @@ bool cLiveStreamer::Open(int serial)
 {
   Close();
 
-#if APIVERSNUM >= 10725
-  m_Device = cDevice::GetDevice(m_Channel, m_Priority, true, true);
-#else
-  m_Device = cDevice::GetDevice(m_Channel, m_Priority, true);
-#endif
+  // channels watched live without timeshift are demuxed once for all
+  // clients, everything else gets a demux stage of its own
+  m_Shared = serial == -1 &&
+             !m_Timeshift &&
+             !VNSIServerConfig.testStreamActive &&
+             !PlayRecording;
 
-  if (!m_Device)
-    return false;
-
-  bool recording = false;
-  if (VNSIServerConfig.testStreamActive) // test harness
-  {
-    recording = true;
-    m_VideoBuffer = cVideoBuffer::Create(VNSIServerConfig.testStreamFile);
-  }
-  else if (PlayRecording && serial == -1)
-  {
-#if VDRVERSNUM >= 20301
-    LOCK_TIMERS_READ;
-    for (const cTimer *timer = Timers->First(); timer; timer = Timers->Next(timer))
-#else
-    for (cTimer *timer = Timers.First(); timer; timer = Timers.Next(timer))
-#endif
-    {
-      if (timer &&
-          timer->Recording() &&
-          timer->Channel() == m_Channel)
-      {
-#if VDRVERSNUM >= 20301
-        LOCK_RECORDINGS_READ;
-        cTimer t(*timer);
-        cRecording matchRec(&t, t.Event());
-        const cRecording *rec;
-        {
-          rec = Recordings->GetByName(matchRec.FileName());
-          if (!rec)
-          {
-            return false;
-          }
-        }
-#else
-        Recordings.Load();
-        cRecording matchRec(timer, timer->Event());
-        cRecording *rec;
-        {
-          cThreadLock RecordingsLock(&Recordings);
-          rec = Recordings.GetByName(matchRec.FileName());
-          if (!rec)
-          {
-            return false;
-          }
-        }
-#endif
-        m_VideoBuffer = cVideoBuffer::Create(rec);
-        recording = true;
-        break;
-      }
-    }
-  }
-  if (!recording)
-  {
-    m_VideoBuffer = cVideoBuffer::Create(m_ClientID, m_Timeshift);
-  }
-
-  if (!m_VideoBuffer)
+  std::shared_ptr<cDemuxHub> hub;
+  if (m_Shared)
+    hub = cDemuxHub::Attach(m_Channel, m_Priority, m_AllowRDS, &m_Queue, m_refTime, m_refDTS);
+  else
+    hub = cDemuxHub::OpenPrivate(m_Channel, m_Priority, m_AllowRDS, m_ClientID, m_Timeshift, serial,
+                                 &m_Queue, m_refTime, m_refDTS);
+  if (!hub)
     return false;
 
-  if (!recording)
-  {
-    if (m_Channel && ((m_Channel->Source() >> 24) == 'V'))
-      m_IsMPEGPS = true;
-
-    if (!m_VideoInput.Open(m_Channel, m_Priority, m_VideoBuffer))
-    {
-      ERRORLOG("Can't switch to channel %i - %s", m_Channel->Number(), m_Channel->Name());
-      return false;
-    }
-  }
-
-  m_Demuxer.Open(*m_Channel, m_VideoBuffer);
-  if (serial >= 0)
-    m_Demuxer.SetSerial(serial);
+  cMutexLock lock(&m_HubMutex);
+  m_Hub = hub;
+  m_Device = m_Hub->GetDevice();
+  if (m_Channel && ((m_Channel->Source() >> 24) == 'V'))
+    m_IsMPEGPS = true;
 
   return true;
 }
@@ -168,152 +120,80 @@ bool cLiveStreamer::Open(int serial)
 void cLiveStreamer::Close(void)
 {
   INFOLOG("LiveStreamer::Close - close");
-  m_VideoInput.Close();
-  m_Demuxer.Close();
-  if (m_VideoBuffer)
   {
-    delete m_VideoBuffer;
-    m_VideoBuffer = NULL;
+    cMutexLock lock(&m_HubMutex);
+    if (m_Hub)
+      cDemuxHub::Detach(m_Hub, &m_Queue);
   }
+  m_Queue.Clear();
 
   if (m_Frontend >= 0)
   {
     close(m_Frontend);
     m_Frontend = -1;
   }
+  m_SignalDevice[0] = 0;
 }
 
 void cLiveStreamer::Action(void)
 {
-  int ret;
-  sStreamPacket pkt_data;
-  sStreamPacket pkt_side_data; // Additional data
-  memset(&pkt_data, 0, sizeof(sStreamPacket));
-  memset(&pkt_side_data, 0, sizeof(sStreamPacket));
-  bool requestStreamChangeData = false;
-  bool requestStreamChangeSideData = false;
   cTimeMs last_info(1000);
   cTimeMs bufferStatsTimer(1000);
-  int openFailCount = 0;
+  cTimeMs statsTimer(0);
 
   while (Running())
   {
-    cVideoInput::eReceivingStatus retune = cVideoInput::NORMAL;
-    if (m_VideoInput.IsOpen())
-      retune = m_VideoInput.ReceivingStatus();
-    if (retune == cVideoInput::RETUNE)
-      // allow timeshift playback when retune == cVideoInput::CLOSE
-      ret = -1;
-    else
-      ret = m_Demuxer.Read(&pkt_data, &pkt_side_data);
+    if (m_SendStatus.exchange(false))
+      sendStreamTimes();
 
-    if (ret > 0)
+    if (statsTimer.TimedOut())
     {
-      if (pkt_data.pmtChange)
-      {
-        requestStreamChangeData = true;
-        requestStreamChangeSideData = true;
-      }
+      updateStats();
+      statsTimer.Set(1000);
+    }
 
-      // Process normal data if present
-      if (pkt_data.data)
+    // the client does not keep up (or paused), continue on a timeshift
+    // buffer of its own instead of holding back the other viewers; with
+    // timeshift disabled there is no buffer to go to, a second live
+    // receiver would drop just the same, so the shared queue keeps
+    // dropping for this client
+    if (m_Shared && TimeshiftMode != 0 && m_Queue.Overflowed())
+    {
+      INFOLOG("Client %i stalled, detaching from shared demuxer", m_ClientID);
+      flushFrames();
+      m_Timeshift = 1;
+      if (!Open(m_Hub->GetSerial()))
       {
-        if (pkt_data.streamChange || requestStreamChangeData)
-          sendStreamChange();
-        requestStreamChangeData = false;
-        if (pkt_data.reftime)
-        {
-          m_refTime = pkt_data.reftime;
-          m_refDTS = pkt_data.dts;
-          m_curDTS = (pkt_data.dts - m_refDTS) / DVD_TIME_BASE + m_refTime;
-          if (m_protocolVersion >= 11)
-          {
-            sendStreamTimes();
-            bufferStatsTimer.Set(1000);
-          }
-          else
-            sendRefTime(pkt_data);
-          pkt_data.reftime = 0;
-        }
-        m_curDTS = (pkt_data.dts - m_refDTS) / DVD_TIME_BASE + m_refTime;
-        if (bufferStatsTimer.TimedOut())
-        {
-          sendStreamTimes();
-          bufferStatsTimer.Set(1000);
-        }
-        sendStreamPacket(&pkt_data);
+        m_Socket->Shutdown();
+        break;
       }
+      continue;
+    }
 
-      // If some additional data is present inside the stream, it is written there (currently RDS inside MPEG2-Audio)
-      if (pkt_side_data.data)
+    cStreamFrame *frame = m_Queue.Pop();
+    if (!frame)
+    {
+      // queue drained, give the demuxer the rest of the window to add
+      // to the batch
+      if (m_BatchCount && m_BatchWindow > 0 && m_BatchTimer.Elapsed() < (uint64_t)m_BatchWindow)
       {
-        if (pkt_side_data.streamChange || requestStreamChangeSideData)
-          sendStreamChange();
-        requestStreamChangeSideData = false;
-
-        sendStreamPacket(&pkt_side_data);
-        pkt_side_data.data = NULL;
+        m_Event.Wait(m_BatchWindow - m_BatchTimer.Elapsed());
+        continue;
       }
 
-      // send signal info every 10 sec.
-      if (last_info.TimedOut())
-      {
-        last_info.Set(10000);
-        sendSignalInfo();
-
-        // prevent EPG scan (activity timeout is 60s)
-        // EPG scan can cause artifacts on dual tuner cards
-        if (AvoidEPGScan)
-        {
-          EITScanner.Activity();
-        }
-      }
+      // send what has been gathered
+      flushFrames();
 
-      if (m_protocolVersion < 11)
-      {
-        // send buffer stats
-        if (bufferStatsTimer.TimedOut())
-        {
-          sendBufferStatus();
-          bufferStatsTimer.Set(1000);
-        }
-      }
-    }
-    else if (ret == -1)
-    {
       // no data
-      if (retune == cVideoInput::CLOSE)
+      if (m_Hub->IsClosed())
       {
         m_Socket->Shutdown();
         break;
       }
-      if (m_Demuxer.GetError() & ERROR_CAM_ERROR)
-      {
-        INFOLOG("CAM error, try reset");
-        cCamSlot *cs = m_Device->CamSlot();
-        if (cs)
-          cs->StopDecrypting();
-        retune = cVideoInput::RETUNE;
-      }
-      if (retune == cVideoInput::RETUNE)
-      {
-        INFOLOG("re-tuning...");
-        m_VideoInput.Close();
-        if (!m_VideoInput.Open(m_Channel, m_Priority, m_VideoBuffer))
-        {
-          if (++openFailCount == 3)
-          {
-            openFailCount = 0;
-            cCondWait::SleepMs(2000);
-          }
-          else
-            cCondWait::SleepMs(100);
-        }
-        else
-          openFailCount = 0;
-      }
-      else
-        m_Event.Wait(10);
+
+      // frames, status requests and the hub closing signal the event,
+      // the timeout only drives the scan timeout check below
+      m_Event.Wait(1000);
 
       if(m_last_tick.Elapsed() >= (uint64_t)(m_scanTimeout*1000))
       {
@@ -321,19 +201,74 @@ void cLiveStreamer::Action(void)
         m_last_tick.Set(0);
         m_SignalLost = true;
       }
+      continue;
     }
-    else if (ret == -2)
+
+    if (frame->kind == cStreamFrame::STREAMCHANGE)
     {
-      if (!Open(m_Demuxer.GetSerial()))
+      flushFrames();
+      resetCompact();
+      struct iovec iov;
+      iov.iov_base = frame->Data();
+      iov.iov_len = frame->Size();
+      writeStream(&iov, 1);
+      frame->Release();
+    }
+    else
+    {
+      if (frame->reftime)
+        updateRefTime(frame->reftime, frame->dts, frame->pts, bufferStatsTimer);
+      m_curDTS = (frame->dts - m_refDTS) / DVD_TIME_BASE + m_refTime;
+      if (bufferStatsTimer.TimedOut())
       {
-        m_Socket->Shutdown();
-        break;
+        sendStreamTimes();
+        bufferStatsTimer.Set(1000);
+      }
+      sendStreamPacket(frame);
+    }
+
+    // send signal info every 10 sec.
+    if (last_info.TimedOut())
+    {
+      last_info.Set(10000);
+      sendSignalInfo();
+
+      // prevent EPG scan (activity timeout is 60s)
+      // EPG scan can cause artifacts on dual tuner cards
+      if (AvoidEPGScan)
+      {
+        EITScanner.Activity();
+      }
+    }
+
+    if (m_protocolVersion < 11)
+    {
+      // send buffer stats
+      if (bufferStatsTimer.TimedOut())
+      {
+        sendBufferStatus();
+        bufferStatsTimer.Set(1000);
       }
     }
   }
+  flushFrames();
   INFOLOG("exit streamer thread");
 }
 
+void cLiveStreamer::updateRefTime(time_t reftime, int64_t dts, int64_t pts, cTimeMs &bufferStatsTimer)
+{
+  m_refTime = reftime;
+  m_refDTS = dts;
+  m_curDTS = (dts - m_refDTS) / DVD_TIME_BASE + m_refTime;
+  if (m_protocolVersion >= 11)
+  {
+    sendStreamTimes();
+    bufferStatsTimer.Set(1000);
+  }
+  else
+    sendRefTime(reftime, pts);
+}
+
 bool cLiveStreamer::StreamChannel(const cChannel *channel, int priority, cxSocket *Socket, cResponsePacket *resp)
 {
   if (channel == NULL)
@@ -346,6 +281,9 @@ bool cLiveStreamer::StreamChannel(const cChannel *channel, int priority, cxSocke
   m_Priority  = priority;
   m_Socket    = Socket;
 
+  if (!m_Ring && VNSIServerConfig.zerocopy)
+    m_Socket->EnableZerocopy();
+
   if (m_Priority < 0)
     m_Priority = 0;
 
@@ -373,167 +311,253 @@ inline void cLiveStreamer::Activate(bool On)
   else
   {
     DEBUGLOG("VDR inactive, sending stream end message");
+    // the thread blocks until data arrives, wake it up to notice
+    Cancel(-1);
+    m_Event.Signal();
     Cancel(5);
   }
 }
 
-void cLiveStreamer::sendStreamPacket(sStreamPacket *pkt)
+void cLiveStreamer::sendStreamPacket(cStreamFrame *frame)
 {
-  if (pkt == NULL)
-    return;
-
-  if (pkt->size == 0)
-    return;
-
-  m_streamHeader.initStream(VNSI_STREAM_MUXPKT, pkt->id, pkt->duration, pkt->pts, pkt->dts, pkt->serial);
-  m_streamHeader.setLen(m_streamHeader.getStreamHeaderLength() + pkt->size);
-  m_streamHeader.finaliseStream();
-
-  m_Socket->LockWrite();
-  m_Socket->write(m_streamHeader.getPtr(), m_streamHeader.getStreamHeaderLength(), -1, true);
-  m_Socket->write(pkt->data, pkt->size);
-  m_Socket->UnlockWrite();
+  // header and payload were serialised by the demux stage, gather
+  // frames until the queue is drained so that runs of small (audio)
+  // frames go out in one syscall
+  if (m_BatchCount == 0)
+    m_BatchTimer.Set(0);
+  if (m_Pacer)
+    m_Pacer->AddMedia(cPacer::LIVE, frame->Size(), frame->dts);
+  if (m_Compact)
+  {
+    m_CompactLength[m_BatchCount] = compactHeader(frame, m_CompactHeader[m_BatchCount]);
+    m_BatchBytes += m_CompactLength[m_BatchCount] + frame->Size() - m_infoPacket.getStreamHeaderLength();
+  }
+  else
+    m_BatchBytes += frame->Size();
+  m_Batch[m_BatchCount++] = frame;
+  if (m_BatchCount == MAX_BATCH_FRAMES || m_BatchBytes >= MAX_BATCH_BYTES)
+    flushFrames();
 
   m_last_tick.Set(0);
   m_SignalLost = false;
 }
 
-void cLiveStreamer::sendStreamChange()
+static void releaseFrame(void *frame)
 {
-  cResponsePacket resp;
-  resp.initStream(VNSI_STREAM_CHANGE, 0, 0, 0, 0, 0);
+  ((cStreamFrame*)frame)->Release();
+}
 
-  uint32_t FpsScale, FpsRate, Height, Width;
-  double Aspect;
-  uint32_t Channels, SampleRate, BitRate, BitsPerSample, BlockAlign;
-  for (cTSStream* stream = m_Demuxer.GetFirstStream(); stream; stream = m_Demuxer.GetNextStream())
+void cLiveStreamer::flushFrames()
+{
+  if (m_BatchCount == 0)
+    return;
+
+  struct iovec iov[MAX_BATCH_FRAMES * 2 + 1];
+  cStreamFrame *owner[MAX_BATCH_FRAMES * 2 + 1];  // frame whose buffer an entry points into
+  int iovcnt = 0;
+  if (m_MuxBatch && m_BatchCount > 1)
   {
-    resp.add_U32(stream->GetPID());
-    if (stream->Type() == stMPEG2AUDIO)
-    {
-      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
-      resp.add_String("MPEG2AUDIO");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(Channels);
-      resp.add_U32(SampleRate);
-      resp.add_U32(BlockAlign);
-      resp.add_U32(BitRate);
-      resp.add_U32(BitsPerSample);
-
-      for (const auto &i : stream->GetSideDataTypes())
-      {
-        resp.add_U32(i.first);
-        if (i.second == scRDS)
-        {
-          resp.add_String("RDS");
-          resp.add_String(stream->GetLanguage());
-          resp.add_U32(stream->GetPID());
-        }
-      }
-    }
-    else if (stream->Type() == stMPEG2VIDEO)
-    {
-      stream->GetVideoInformation(FpsScale, FpsRate, Height, Width, Aspect);
-      resp.add_String("MPEG2VIDEO");
-      resp.add_U32(FpsScale);
-      resp.add_U32(FpsRate);
-      resp.add_U32(Height);
-      resp.add_U32(Width);
-      resp.add_double(Aspect);
-    }
-    else if (stream->Type() == stAC3)
-    {
-      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
-      resp.add_String("AC3");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(Channels);
-      resp.add_U32(SampleRate);
-      resp.add_U32(BlockAlign);
-      resp.add_U32(BitRate);
-      resp.add_U32(BitsPerSample);
-    }
-    else if (stream->Type() == stH264)
+    // one message for the batch, the packets inside are unchanged
+    size_t headerLength = m_batchPacket.getStreamHeaderLength();
+    m_batchPacket.initStream(VNSI_STREAM_MUXPKT_BATCH, m_BatchCount, 0, 0, 0, 0);
+    m_batchPacket.setLen(headerLength + m_BatchBytes);
+    m_batchPacket.finaliseStream();
+    iov[iovcnt].iov_base = m_batchPacket.getPtr();
+    iov[iovcnt].iov_len = headerLength;
+    owner[iovcnt] = nullptr;
+    iovcnt++;
+  }
+  for (int i = 0; i < m_BatchCount; i++)
+  {
+    if (m_Compact)
     {
-      stream->GetVideoInformation(FpsScale, FpsRate, Height, Width, Aspect);
-      resp.add_String("H264");
-      resp.add_U32(FpsScale);
-      resp.add_U32(FpsRate);
-      resp.add_U32(Height);
-      resp.add_U32(Width);
-      resp.add_double(Aspect);
+      // the compact header replaces the one serialised by the demux stage
+      size_t headerLength = m_infoPacket.getStreamHeaderLength();
+      iov[iovcnt].iov_base = m_CompactHeader[i];
+      iov[iovcnt].iov_len = m_CompactLength[i];
+      owner[iovcnt] = nullptr;
+      iovcnt++;
+      iov[iovcnt].iov_base = m_Batch[i]->Data() + headerLength;
+      iov[iovcnt].iov_len = m_Batch[i]->Size() - headerLength;
     }
-    else if (stream->Type() == stHEVC)
+    else
     {
-      stream->GetVideoInformation(FpsScale, FpsRate, Height, Width, Aspect);
-      resp.add_String("HEVC");
-      resp.add_U32(FpsScale);
-      resp.add_U32(FpsRate);
-      resp.add_U32(Height);
-      resp.add_U32(Width);
-      resp.add_double(Aspect);
+      iov[iovcnt].iov_base = m_Batch[i]->Data();
+      iov[iovcnt].iov_len = m_Batch[i]->Size();
     }
-    else if (stream->Type() == stDVBSUB)
+    owner[iovcnt] = m_Batch[i];
+    iovcnt++;
+  }
+
+  // large frames go by reference, each holding its frame until the
+  // kernel is done with it, the small parts between them by copy, all in
+  // one call
+  bool zerocopy = false;
+  void *contexts[MAX_BATCH_FRAMES * 2 + 1];
+  if (!m_Ring && m_Socket->IsZerocopy())
+  {
+    for (int i = 0; i < iovcnt; i++)
     {
-      resp.add_String("DVBSUB");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(stream->CompositionPageId());
-      resp.add_U32(stream->AncillaryPageId());
+      contexts[i] = nullptr;
+      if (owner[i] && iov[i].iov_len >= ZEROCOPY_MIN_SIZE)
+      {
+        owner[i]->AddRef();
+        contexts[i] = owner[i];
+        zerocopy = true;
+      }
     }
-    else if (stream->Type() == stTELETEXT)
+  }
+  if (zerocopy)
+  {
+    if (m_Pacer)
     {
-      resp.add_String("TELETEXT");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(stream->CompositionPageId());
-      resp.add_U32(stream->AncillaryPageId());
+      size_t bytes = 0;
+      for (int i = 0; i < iovcnt; i++)
+        bytes += iov[i].iov_len;
+      m_Pacer->Wait(bytes);
     }
-    else if (stream->Type() == stAACADTS)
+    m_Socket->writevZerocopy(iov, iovcnt, contexts, releaseFrame);
+  }
+  else
+    writeStream(iov, iovcnt);
+
+  for (int i = 0; i < m_BatchCount; i++)
+    m_Batch[i]->Release();
+  m_BatchCount = 0;
+  m_BatchBytes = 0;
+}
+
+static inline uint8_t *putVarint(uint8_t *p, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    *p++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *p++ = value;
+  return p;
+}
+
+static inline uint64_t zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+size_t cLiveStreamer::compactHeader(cStreamFrame *frame, uint8_t *buffer)
+{
+  uint32_t length = frame->Size() - m_infoPacket.getStreamHeaderLength();
+
+  uint8_t flags = 0;
+  if (frame->dts != frame->pts)
+    flags |= VNSI_COMPACT_DTS;
+  if (frame->duration)
+    flags |= VNSI_COMPACT_DURATION;
+  if (frame->serial != m_CompactSerial)
+    flags |= VNSI_COMPACT_SERIAL;
+
+  // differences wrap like the client's unsigned arithmetic, also for
+  // DVD_NOPTS_VALUE
+  int64_t &lastPTS = m_CompactPTS[frame->id];
+
+  uint32_t ul = htonl(VNSI_CHANNEL_STREAM_COMPACT);
+  memcpy(buffer, &ul, sizeof(uint32_t));
+  uint8_t *p = buffer + sizeof(uint32_t);
+  *p++ = flags;
+  p = putVarint(p, zigzag((int32_t)(frame->id - m_CompactStream)));
+  p = putVarint(p, zigzag((int64_t)((uint64_t)frame->pts - (uint64_t)lastPTS)));
+  if (flags & VNSI_COMPACT_DTS)
+    p = putVarint(p, zigzag((int64_t)((uint64_t)frame->dts - (uint64_t)frame->pts)));
+  if (flags & VNSI_COMPACT_DURATION)
+    p = putVarint(p, frame->duration);
+  if (flags & VNSI_COMPACT_SERIAL)
+    p = putVarint(p, frame->serial);
+  p = putVarint(p, length);
+
+  m_CompactStream = frame->id;
+  m_CompactSerial = frame->serial;
+  lastPTS = frame->pts;
+  return p - buffer;
+}
+
+void cLiveStreamer::resetCompact()
+{
+  m_CompactStream = 0;
+  m_CompactSerial = 0;
+  m_CompactPTS.clear();
+}
+
+void cLiveStreamer::writeStream(struct iovec *iov, int iovcnt)
+{
+  if (!m_Ring)
+  {
+    if (m_Pacer)
     {
-      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
-      resp.add_String("AAC");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(Channels);
-      resp.add_U32(SampleRate);
-      resp.add_U32(BlockAlign);
-      resp.add_U32(BitRate);
-      resp.add_U32(BitsPerSample);
+      size_t bytes = 0;
+      for (int i = 0; i < iovcnt; i++)
+        bytes += iov[i].iov_len;
+      m_Pacer->Wait(bytes);
     }
-    else if (stream->Type() == stAACLATM)
+    m_Socket->writev(iov, iovcnt);
+    return;
+  }
+
+  size_t bytes = 0;
+  for (int i = 0; i < iovcnt; i++)
+    bytes += iov[i].iov_len;
+  if (bytes <= m_Ring->GetSize())
+  {
+    writeRing(iov, iovcnt);
+    return;
+  }
+
+  // larger than the ring, the client reads it as a byte stream like the
+  // socket, so it goes in pieces the ring can take
+  size_t piece = m_Ring->GetSize() / 2;
+  for (int i = 0; i < iovcnt; i++)
+  {
+    for (size_t offset = 0; offset < iov[i].iov_len; offset += piece)
     {
-      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
-      resp.add_String("AAC_LATM");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(Channels);
-      resp.add_U32(SampleRate);
-      resp.add_U32(BlockAlign);
-      resp.add_U32(BitRate);
-      resp.add_U32(BitsPerSample);
+      struct iovec part;
+      part.iov_base = (uint8_t*)iov[i].iov_base + offset;
+      part.iov_len = std::min(piece, iov[i].iov_len - offset);
+      if (!writeRing(&part, 1))
+        return;
     }
-    else if (stream->Type() == stEAC3)
+  }
+}
+
+bool cLiveStreamer::writeRing(struct iovec *iov, int iovcnt)
+{
+  // the ring has no short writes, wait for the client to make room like
+  // a blocking socket would
+  while (Running())
+  {
+    ssize_t written = m_Ring->Write(iov, iovcnt, 1000);
+    if (written > 0)
     {
-      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
-      resp.add_String("EAC3");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(Channels);
-      resp.add_U32(SampleRate);
-      resp.add_U32(BlockAlign);
-      resp.add_U32(BitRate);
-      resp.add_U32(BitsPerSample);
+      m_Ring->Notify();
+      return true;
     }
-    else if (stream->Type() == stDTS)
+    else if (written < 0)
     {
-      stream->GetAudioInformation(Channels, SampleRate, BitRate, BitsPerSample, BlockAlign);
-      resp.add_String("DTS");
-      resp.add_String(stream->GetLanguage());
-      resp.add_U32(Channels);
-      resp.add_U32(SampleRate);
-      resp.add_U32(BlockAlign);
-      resp.add_U32(BitRate);
-      resp.add_U32(BitsPerSample);
+      ERRORLOG("Stream packets of %i buffers do not fit the shared ring, dropped", iovcnt);
+      return false;
     }
   }
+  return false;
+}
 
+void cLiveStreamer::sendStatusPacket(cResponsePacket &resp)
+{
   resp.finaliseStream();
-  m_Socket->write(resp.getPtr(), resp.getLen());
+
+  if (m_statusSocket)
+    m_statusSocket->write(resp.getPtr(), resp.getLen());
+  else
+  {
+    flushFrames();
+    m_Socket->write(resp.getPtr(), resp.getLen());
+  }
 }
 
 // taken from vdr 2.3.4+ keeping the comments
@@ -561,23 +585,19 @@ void cLiveStreamer::sendSignalInfo()
 
   /* If no frontend is found m_Frontend is set to -2, in this case
      return a empty signalinfo package */
+  cResponsePacket &resp = m_infoPacket;
+
   if (m_Frontend == -2)
   {
-    cResponsePacket resp;
     resp.initStream(VNSI_STREAM_SIGNALINFO, 0, 0, 0, 0, 0);
-    resp.add_String(*cString::sprintf("Unknown"));
-    resp.add_String(*cString::sprintf("Unknown"));
+    resp.add_String("Unknown");
+    resp.add_String("Unknown");
     resp.add_U32(0);
     resp.add_U32(0);
     resp.add_U32(0);
     resp.add_U32(0);
 
-    resp.finaliseStream();
-
-    if (m_statusSocket)
-      m_statusSocket->write(resp.getPtr(), resp.getLen());
-    else
-      m_Socket->write(resp.getPtr(), resp.getLen());
+    sendStatusPacket(resp);
     return;
   }
 
@@ -599,6 +619,7 @@ void cLiveStreamer::sendSignalInfo()
             memset(&m_vcap, 0, sizeof(m_vcap));
             continue;
           }
+          snprintf(m_SignalDevice, sizeof(m_SignalDevice), "Analog #%s - %s (%s)", *m_DeviceString, (char *) m_vcap.card, m_vcap.driver);
           break;
         }
       }
@@ -608,21 +629,15 @@ void cLiveStreamer::sendSignalInfo()
 
     if (m_Frontend >= 0)
     {
-      cResponsePacket resp;
       resp.initStream(VNSI_STREAM_SIGNALINFO, 0, 0, 0, 0, 0);
-      resp.add_String(*cString::sprintf("Analog #%s - %s (%s)", *m_DeviceString, (char *) m_vcap.card, m_vcap.driver));
+      resp.add_String(m_SignalDevice);
       resp.add_String("");
       resp.add_U32(0);
       resp.add_U32(0);
       resp.add_U32(0);
       resp.add_U32(0);
 
-      resp.finaliseStream();
-
-      if (m_statusSocket)
-        m_statusSocket->write(resp.getPtr(), resp.getLen());
-      else
-        m_Socket->write(resp.getPtr(), resp.getLen());
+      sendStatusPacket(resp);
     }
   }
   else
@@ -641,12 +656,30 @@ void cLiveStreamer::sendSignalInfo()
           memset(&m_FrontendInfo, 0, sizeof(m_FrontendInfo));
           return;
         }
+
+        switch (m_Channel->Source() & cSource::st_Mask)
+        {
+          case cSource::stSat:
+            snprintf(m_SignalDevice, sizeof(m_SignalDevice), "DVB-S%s #%d - %s", (m_FrontendInfo.caps & 0x10000000) ? "2" : "",  m_Device->CardIndex(), m_FrontendInfo.name);
+            break;
+          case cSource::stCable:
+            snprintf(m_SignalDevice, sizeof(m_SignalDevice), "DVB-C #%d - %s", m_Device->CardIndex(), m_FrontendInfo.name);
+            break;
+          case cSource::stTerr:
+            snprintf(m_SignalDevice, sizeof(m_SignalDevice), "DVB-T #%d - %s", m_Device->CardIndex(), m_FrontendInfo.name);
+            break;
+          case cSource::stAtsc:
+            snprintf(m_SignalDevice, sizeof(m_SignalDevice), "ATSC #%d - %s", m_Device->CardIndex(), m_FrontendInfo.name);
+            break;
+          default:
+            m_SignalDevice[0] = 0;
+            break;
+        }
       }
     }
 
     if (m_Frontend >= 0)
     {
-      cResponsePacket resp;
       resp.initStream(VNSI_STREAM_SIGNALINFO, 0, 0, 0, 0, 0);
 
       fe_status_t status;
@@ -745,77 +778,55 @@ void cLiveStreamer::sendSignalInfo()
       if (unc_needed && ioctl(m_Frontend, FE_READ_UNCORRECTED_BLOCKS, &fe_unc) == -1)
         fe_unc = -2;
 
-      switch (m_Channel->Source() & cSource::st_Mask)
-      {
-        case cSource::stSat:
-          resp.add_String(*cString::sprintf("DVB-S%s #%d - %s", (m_FrontendInfo.caps & 0x10000000) ? "2" : "",  m_Device->CardIndex(), m_FrontendInfo.name));
-          break;
-        case cSource::stCable:
-          resp.add_String(*cString::sprintf("DVB-C #%d - %s", m_Device->CardIndex(), m_FrontendInfo.name));
-          break;
-        case cSource::stTerr:
-          resp.add_String(*cString::sprintf("DVB-T #%d - %s", m_Device->CardIndex(), m_FrontendInfo.name));
-          break;
-        case cSource::stAtsc:
-          resp.add_String(*cString::sprintf("ATSC #%d - %s", m_Device->CardIndex(), m_FrontendInfo.name));
-          break;
-        default:
-          resp.add_U8(0);
-          break;
-      }
-      resp.add_String(*cString::sprintf("%s:%s:%s:%s:%s", (status & FE_HAS_LOCK) ? "LOCKED" : "-", (status & FE_HAS_SIGNAL) ? "SIGNAL" : "-", (status & FE_HAS_CARRIER) ? "CARRIER" : "-", (status & FE_HAS_VITERBI) ? "VITERBI" : "-", (status & FE_HAS_SYNC) ? "SYNC" : "-"));
+      char lockStatus[48];
+      snprintf(lockStatus, sizeof(lockStatus), "%s:%s:%s:%s:%s", (status & FE_HAS_LOCK) ? "LOCKED" : "-", (status & FE_HAS_SIGNAL) ? "SIGNAL" : "-", (status & FE_HAS_CARRIER) ? "CARRIER" : "-", (status & FE_HAS_VITERBI) ? "VITERBI" : "-", (status & FE_HAS_SYNC) ? "SYNC" : "-");
+
+      resp.add_String(m_SignalDevice);
+      resp.add_String(lockStatus);
       resp.add_U32(fe_snr);
       resp.add_U32(fe_signal);
       resp.add_U32(fe_ber);
       resp.add_U32(fe_unc);
 
-      resp.finaliseStream();
-
-      if (m_statusSocket)
-        m_statusSocket->write(resp.getPtr(), resp.getLen());
-      else
-        m_Socket->write(resp.getPtr(), resp.getLen());
+      sendStatusPacket(resp);
     }
   }
 }
 
 void cLiveStreamer::sendStreamStatus()
 {
-  cResponsePacket resp;
+  cResponsePacket &resp = m_infoPacket;
   resp.initStream(VNSI_STREAM_STATUS, 0, 0, 0, 0, 0);
-  uint16_t error = m_Demuxer.GetError();
+  uint16_t error = m_Hub->GetError();
+  char msg[64];
   if (error & ERROR_PES_SCRAMBLE)
   {
     INFOLOG("Channel: scrambled (PES) %d", error);
-    resp.add_String(cString::sprintf("Channel: scrambled (%d)", error));
+    snprintf(msg, sizeof(msg), "Channel: scrambled (%d)", error);
   }
   else if (error & ERROR_TS_SCRAMBLE)
   {
     INFOLOG("Channel: scrambled (TS) %d", error);
-    resp.add_String(cString::sprintf("Channel: scrambled (%d)", error));
+    snprintf(msg, sizeof(msg), "Channel: scrambled (%d)", error);
   }
   else if (error & ERROR_PES_STARTCODE)
   {
     INFOLOG("Channel: startcode %d", error);
-    resp.add_String(cString::sprintf("Channel: encrypted? (%d)", error));
+    snprintf(msg, sizeof(msg), "Channel: encrypted? (%d)", error);
   }
   else if (error & ERROR_DEMUX_NODATA)
   {
     INFOLOG("Channel: no data %d", error);
-    resp.add_String(cString::sprintf("Channel: no data"));
+    snprintf(msg, sizeof(msg), "Channel: no data");
   }
   else
   {
     INFOLOG("Channel: unknown error %d", error);
-    resp.add_String(cString::sprintf("Channel: unknown error (%d)", error));
+    snprintf(msg, sizeof(msg), "Channel: unknown error (%d)", error);
   }
+  resp.add_String(msg);
 
-  resp.finaliseStream();
-
-  if (m_statusSocket)
-    m_statusSocket->write(resp.getPtr(), resp.getLen());
-  else
-    m_Socket->write(resp.getPtr(), resp.getLen());
+  sendStatusPacket(resp);
 }
 
 void cLiveStreamer::sendStreamTimes()
@@ -823,7 +834,7 @@ void cLiveStreamer::sendStreamTimes()
   if (m_Channel == NULL)
     return;
 
-  cResponsePacket resp;
+  cResponsePacket &resp = m_infoPacket;
   resp.initStream(VNSI_STREAM_TIMES, 0, 0, 0, 0, 0);
 
   time_t starttime = m_refTime;
@@ -854,7 +865,7 @@ void cLiveStreamer::sendStreamTimes()
   bool timeshift;
   int64_t mintime = current;
   int64_t maxtime = current;
-  m_Demuxer.BufferStatus(timeshift, start, end);
+  m_Hub->BufferStatus(timeshift, start, end);
   if (timeshift)
   {
     mintime = (start - starttime) * DVD_TIME_BASE + refDTS;
@@ -866,52 +877,59 @@ void cLiveStreamer::sendStreamTimes()
   resp.add_U64(refDTS);
   resp.add_U64(mintime);
   resp.add_U64(maxtime);
-  resp.finaliseStream();
 
-  if (m_statusSocket)
-    m_statusSocket->write(resp.getPtr(), resp.getLen());
-  else
-    m_Socket->write(resp.getPtr(), resp.getLen());
+  sendStatusPacket(resp);
 }
 
 void cLiveStreamer::sendBufferStatus()
 {
-  cResponsePacket resp;
+  cResponsePacket &resp = m_infoPacket;
   resp.initStream(VNSI_STREAM_BUFFERSTATS, 0, 0, 0, 0, 0);
   uint32_t start, end;
   bool timeshift;
-  m_Demuxer.BufferStatus(timeshift, start, end);
+  m_Hub->BufferStatus(timeshift, start, end);
   resp.add_U8(timeshift);
   resp.add_U32(start);
   resp.add_U32(end);
   resp.finaliseStream();
+  flushFrames();
   m_Socket->write(resp.getPtr(), resp.getLen());
 }
 
-void cLiveStreamer::sendRefTime(sStreamPacket &pkt)
+void cLiveStreamer::sendRefTime(uint32_t reftime, int64_t pts)
 {
-  cResponsePacket resp;
+  cResponsePacket &resp = m_infoPacket;
   resp.initStream(VNSI_STREAM_REFTIME, 0, 0, 0, 0, 0);
-  resp.add_U32(pkt.reftime);
-  resp.add_U64(pkt.pts);
+  resp.add_U32(reftime);
+  resp.add_U64(pts);
   resp.finaliseStream();
+  flushFrames();
   m_Socket->write(resp.getPtr(), resp.getLen());
 }
 
 bool cLiveStreamer::SeekTime(int64_t time, uint32_t &serial)
 {
-  bool ret = m_Demuxer.SeekTime(time);
-  serial = m_Demuxer.GetSerial();
-  return ret;
+  cMutexLock lock(&m_HubMutex);
+  if (!m_Hub)
+    return false;
+
+  // no buffer to seek in while demuxing with other clients
+  if (m_Shared)
+  {
+    serial = m_Hub->GetSerial();
+    return false;
+  }
+
+  // frames queued before the seek belong to the old position
+  m_Queue.Clear();
+  return m_Hub->SeekTime(time, serial);
 }
 
 void cLiveStreamer::RetuneChannel(const cChannel *channel)
 {
-  if (m_Channel != channel || !m_VideoInput.IsOpen())
-    return;
-
-  INFOLOG("re-tune to channel %s", m_Channel->Name());
-  m_VideoInput.RequestRetune();
+  cMutexLock lock(&m_HubMutex);
+  if (m_Hub)
+    m_Hub->RetuneChannel(channel);
 }
 
 void cLiveStreamer::AddStatusSocket(int fd)
@@ -921,5 +939,21 @@ void cLiveStreamer::AddStatusSocket(int fd)
 
 void cLiveStreamer::SendStatus()
 {
-  sendStreamTimes();
+  // the packets are owned by the streamer thread, let it do the sending
+  m_SendStatus = true;
+  m_Event.Signal();
+}
+
+void cLiveStreamer::updateStats()
+{
+  if (!m_Stats)
+    return;
+
+  unsigned int frames, dropped;
+  size_t bytes;
+  m_Queue.GetStats(frames, bytes, dropped);
+  m_Stats->shared = m_Shared;
+  m_Stats->frames = frames;
+  m_Stats->bytes = bytes;
+  m_Stats->dropped = dropped;
 }
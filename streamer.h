@@ -31,19 +31,34 @@
 
 #include "parser.h"
 #include "responsepacket.h"
-#include "demuxer.h"
-#include "videoinput.h"
+#include "demuxhub.h"
+#include "framequeue.h"
 
+#include <atomic>
+#include <map>
 #include <memory>
 
 class cxSocket;
+class cShmRing;
+class cPacer;
 class cChannel;
 class cTSParser;
 class cResponsePacket;
-class cVideoBuffer;
-class cVideoInput;
 class cDevice;
 
+/*!
+ * Queue figures of a client's streamer for the stats. Owned by the client
+ * and updated by the streamer thread, read without a lock.
+ */
+struct sStreamStats
+{
+  std::atomic<bool> active{false};
+  std::atomic<bool> shared{false};
+  std::atomic<unsigned int> frames{0};
+  std::atomic<size_t> bytes{0};
+  std::atomic<unsigned int> dropped{0};
+};
+
 class cLiveStreamer : public cThread
 {
   friend class cParser;
@@ -59,6 +74,18 @@ public:
   void Activate(bool On);
 
   bool StreamChannel(const cChannel *channel, int priority, cxSocket *Socket, cResponsePacket* resp);
+  /*!
+   * Write stream packets to the ring instead of the socket, to be set
+   * before StreamChannel. Status packets stay on the socket.
+   */
+  void SetRing(std::shared_ptr<cShmRing> ring) { m_Ring = ring; }
+  /*!
+   * Send gathered mux packets as one VNSI_STREAM_MUXPKT_BATCH, waiting up
+   * to window_ms for more once the queue is drained.
+   */
+  void SetPacer(cPacer *pacer) { m_Pacer = pacer; }
+  void SetStats(sStreamStats *stats) { m_Stats = stats; }
+  void SetBatchWindow(int window_ms) { m_MuxBatch = true; m_BatchWindow = window_ms; }
   bool IsStarting() { return m_startup; }
   bool IsAudioOnly() { return m_IsAudioOnly; }
   bool IsMPEGPS() { return m_IsMPEGPS; }
@@ -71,24 +98,35 @@ protected:
   virtual void Action(void);
   bool Open(int serial = -1);
   void Close();
+  void updateRefTime(time_t reftime, int64_t dts, int64_t pts, cTimeMs &bufferStatsTimer);
 
-  void sendStreamPacket(sStreamPacket *pkt);
-  void sendStreamChange();
+  void sendStreamPacket(cStreamFrame *frame);
+  void flushFrames();
+  size_t compactHeader(cStreamFrame *frame, uint8_t *buffer);
+  void resetCompact();
+  void writeStream(struct iovec *iov, int iovcnt);
+  bool writeRing(struct iovec *iov, int iovcnt);
   void sendSignalInfo();
   void sendStreamStatus();
   void sendBufferStatus();
-  void sendRefTime(sStreamPacket &pkt);
+  void sendRefTime(uint32_t reftime, int64_t pts);
   void sendStreamTimes();
+  void sendStatusPacket(cResponsePacket &resp);
+  void updateStats();
 
   const int m_ClientID;
   const cChannel *m_Channel = nullptr;
   cDevice *m_Device;
   cxSocket *m_Socket = nullptr;             /*!> The socket class to communicate with client */
+  std::shared_ptr<cShmRing> m_Ring;         /*!> Shared memory for stream packets of a local client */
+  cPacer *m_Pacer = nullptr;                /*!> Owned by the client, measures and paces the stream */
+  sStreamStats *m_Stats = nullptr;          /*!> Owned by the client */
   std::unique_ptr<cxSocket> m_statusSocket;
   int m_Frontend = -1;                      /*!> File descriptor to access used receiving device  */
   dvb_frontend_info m_FrontendInfo;         /*!> DVB Information about the receiving device (DVB only) */
   v4l2_capability m_vcap;                   /*!> PVR Information about the receiving device (pvrinput only) */
   cString m_DeviceString;                   /*!> The name of the receiving device */
+  char m_SignalDevice[128];                 /*!> Device description for signal info, formatted once */
   bool m_startup = true;
   bool m_IsAudioOnly = false;               /*!> Set to true if streams contains only audio */
   bool m_IsMPEGPS = false;                  /*!> TS Stream contains MPEG PS data like from pvrinput */
@@ -96,10 +134,30 @@ protected:
   cTimeMs m_last_tick;
   bool m_SignalLost = false;
   bool m_IFrameSeen = false;
-  cResponsePacket m_streamHeader;
-  cVNSIDemuxer m_Demuxer;
-  cVideoBuffer *m_VideoBuffer = nullptr;
-  cVideoInput m_VideoInput;
+  cResponsePacket m_infoPacket;             /*!> Reused for times, signal, status and stream change */
+  std::atomic<bool> m_SendStatus;           /*!> Set by SendStatus, handled by the streamer thread */
+  bool m_AllowRDS;
+  cMutex m_HubMutex;                        /*!> Guards m_Hub against the client thread */
+  std::shared_ptr<cDemuxHub> m_Hub;         /*!> Demux stage feeding m_Queue */
+  bool m_Shared = false;                    /*!> m_Hub is shared with other clients */
+  cFrameQueue m_Queue;                      /*!> Frames received from m_Hub */
+  static const int MAX_BATCH_FRAMES = 32;
+  static const size_t MAX_BATCH_BYTES = 256*1024;
+  static const size_t ZEROCOPY_MIN_SIZE = 64*1024; /*!> Smaller frames are cheaper to copy */
+  cStreamFrame *m_Batch[MAX_BATCH_FRAMES];  /*!> Frames gathered for one writev */
+  int m_BatchCount = 0;
+  size_t m_BatchBytes = 0;
+  bool m_MuxBatch = false;                  /*!> Send a batch as one VNSI_STREAM_MUXPKT_BATCH */
+  int m_BatchWindow = 0;
+  cTimeMs m_BatchTimer;                     /*!> Started by the first frame of a batch */
+  cResponsePacket m_batchPacket;
+  bool m_Compact;                           /*!> Send VNSI_CHANNEL_STREAM_COMPACT packets */
+  static const size_t MAX_COMPACT_HEADER = 48;
+  uint8_t m_CompactHeader[MAX_BATCH_FRAMES][MAX_COMPACT_HEADER];
+  size_t m_CompactLength[MAX_BATCH_FRAMES];
+  uint32_t m_CompactStream;                 /*!> Stream ID of the previous compact packet */
+  uint32_t m_CompactSerial;
+  std::map<uint32_t, int64_t> m_CompactPTS; /*!> Previous PTS by stream ID */
   int m_Priority;
   uint8_t m_Timeshift;
   cCondWait m_Event;
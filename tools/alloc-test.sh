@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# Checks that live streaming does not allocate once it runs: starts VDR
+# with the plugin playing the test stream file (-T) on all channels,
+# streams a channel with vnsibench and counts the heap allocations of
+# VDR's threads with alloccount.so. After the warm-up, the threads of the
+# streaming path must not allocate for the whole measured time.
+#
+#   $ make -C tools
+#   $ VDR_ARGS="-c /etc/vdr -L /usr/lib/vdr" tools/alloc-test.sh stream.ts
+#
+# VDR           the VDR binary, default vdr
+# VDR_ARGS      further options for VDR, e.g. its config and plugin dirs
+# PORT          the plugin's port, default 34890
+# WARMUP        seconds streamed before counting, default 10
+# DURATION      seconds counted, default 60
+# THREADS       names of the threads that must not allocate, an extended
+#               regular expression, default the streamer and the demuxer
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <test stream file>" >&2
+  exit 2
+fi
+
+TOOLS=$(cd "$(dirname "$0")" && pwd)
+VDR=${VDR:-vdr}
+PORT=${PORT:-34890}
+WARMUP=${WARMUP:-10}
+DURATION=${DURATION:-60}
+THREADS=${THREADS:-'^cLiveStreamer|^cDemuxHub'}
+COUNTS=$(mktemp)
+
+LD_PRELOAD="$TOOLS/alloccount.so" ALLOCCOUNT_FILE="$COUNTS" \
+  $VDR $VDR_ARGS -P "vnsiserver -p $PORT -T $1" >/dev/null 2>&1 &
+VDRPID=$!
+trap 'kill $VDRPID 2>/dev/null; rm -f "$COUNTS"' EXIT
+
+# give VDR time to start and the plugin to listen
+sleep 5
+"$TOOLS/vnsibench" -p "$PORT" -w 0 -t $((WARMUP + DURATION + 5)) stream &
+BENCHPID=$!
+
+sleep "$WARMUP"
+kill -USR1 $VDRPID
+sleep "$DURATION"
+kill -USR2 $VDRPID
+sleep 1
+kill $BENCHPID 2>/dev/null
+wait $BENCHPID 2>/dev/null
+
+if [ ! -s "$COUNTS" ] && ! kill -0 $VDRPID 2>/dev/null; then
+  echo "VDR did not run" >&2
+  exit 1
+fi
+
+FAILED=$(awk -v threads="$THREADS" '{ tid = $1; count = $2; $1 = $2 = ""; sub(/^ +/, ""); if ($0 ~ threads) print tid, count, $0 }' "$COUNTS")
+if [ -n "$FAILED" ]; then
+  echo "allocations in ${DURATION}s after the warm-up (tid, count, thread):"
+  echo "$FAILED"
+  exit 1
+fi
+echo "no allocations in ${DURATION}s after the warm-up"
+exit 0
@@ -0,0 +1,205 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Counts heap allocations per thread, loaded into VDR with LD_PRELOAD.
+ * SIGUSR1 sets the counts to zero, e.g. after a warm-up, SIGUSR2 writes
+ * them to $ALLOCCOUNT_FILE, default /tmp/alloccount.<pid>, one line per
+ * thread that allocated: tid, count and the thread's name. Only
+ * allocations are counted, frees are not. Used by alloc-test.sh.
+ */
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+#define MAX_THREADS 4096
+
+struct sThreadCount
+{
+  std::atomic<int> tid;
+  std::atomic<uint64_t> count;
+};
+
+static sThreadCount counts[MAX_THREADS];
+static __thread sThreadCount *own __attribute__((tls_model("initial-exec")));
+
+static void Count()
+{
+  if (!own)
+  {
+    // a slot for the thread, taken for good, the table never allocates
+    int tid = syscall(SYS_gettid);
+    for (int i = 0; i < MAX_THREADS; i++)
+    {
+      int expected = 0;
+      if (counts[i].tid.compare_exchange_strong(expected, tid))
+      {
+        own = &counts[i];
+        break;
+      }
+    }
+    if (!own)
+      return;
+  }
+  own->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C"
+{
+void *malloc(size_t size)
+{
+  Count();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+  Count();
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  Count();
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+  Count();
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+  Count();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  Count();
+  void *p = __libc_memalign(alignment, size);
+  if (!p)
+    return ENOMEM;
+  *ptr = p;
+  return 0;
+}
+}
+
+// only async-signal-safe calls from here on
+
+static char *PutNumber(char *p, uint64_t value)
+{
+  char digits[24];
+  int n = 0;
+  do
+  {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n)
+    *p++ = digits[--n];
+  return p;
+}
+
+static void Reset(int)
+{
+  for (int i = 0; i < MAX_THREADS; i++)
+    counts[i].count = 0;
+}
+
+static void Dump(int)
+{
+  char path[256];
+  const char *file = getenv("ALLOCCOUNT_FILE");
+  if (!file)
+  {
+    char *p = stpcpy(path, "/tmp/alloccount.");
+    *PutNumber(p, getpid()) = 0;
+    file = path;
+  }
+
+  int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+
+  for (int i = 0; i < MAX_THREADS; i++)
+  {
+    int tid = counts[i].tid;
+    uint64_t count = counts[i].count;
+    if (!tid || !count)
+      continue;
+
+    char line[128];
+    char *p = PutNumber(line, tid);
+    *p++ = ' ';
+    p = PutNumber(p, count);
+    *p++ = ' ';
+
+    char comm[64];
+    char *c = stpcpy(comm, "/proc/self/task/");
+    c = PutNumber(c, tid);
+    strcpy(c, "/comm");
+    int commFd = open(comm, O_RDONLY);
+    ssize_t len = commFd >= 0 ? read(commFd, p, 32) : -1;
+    if (commFd >= 0)
+      close(commFd);
+    if (len > 0)
+      p += len;
+    else
+      *p++ = '\n';
+
+    if (write(fd, line, p - line) < 0)
+      break;
+  }
+  close(fd);
+}
+
+__attribute__((constructor)) static void Init()
+{
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_flags = SA_RESTART;
+  sa.sa_handler = Reset;
+  sigaction(SIGUSR1, &sa, NULL);
+  sa.sa_handler = Dump;
+  sigaction(SIGUSR2, &sa, NULL);
+}
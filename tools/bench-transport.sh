@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Compares a live stream over TCP loopback with one over the plugin's unix
+# domain socket. VDR must run with the plugin listening on both, e.g. with
+# -P "vnsiserver -u /run/vdr/vnsi.sock -T stream.ts" for a synthetic
+# stream on all channels.
+#
+#   $ tools/bench-transport.sh /run/vdr/vnsi.sock
+#
+# PORT          the plugin's TCP port, default 34890
+# CHANNEL       channel number or UID, default 1
+# DURATION      seconds measured per run, default 20
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <unix socket path>" >&2
+  exit 2
+fi
+
+TOOLS=$(cd "$(dirname "$0")" && pwd)
+PORT=${PORT:-34890}
+CHANNEL=${CHANNEL:-1}
+DURATION=${DURATION:-20}
+VDRPID=$(pidof -s vdr)
+
+echo "TCP loopback:"
+"$TOOLS/vnsibench" -p "$PORT" -c "$CHANNEL" -t "$DURATION" ${VDRPID:+-P $VDRPID} stream || exit 1
+echo "unix domain socket:"
+"$TOOLS/vnsibench" -u "$1" -c "$CHANNEL" -t "$DURATION" ${VDRPID:+-P $VDRPID} stream || exit 1
@@ -0,0 +1,20 @@
+#!/bin/sh
+#
+# Writes a channels.conf with n TV channels, default 5000, for measuring
+# the channel lookups with "vnsibench lookup" on a large list. The
+# channels are made up, each has its own service id.
+#
+#   $ tools/gen-channels.sh 5000 > /tmp/vdr/channels.conf
+#   $ vdr -c /tmp/vdr ... &
+#   $ tools/vnsibench lookup
+
+COUNT=${1:-5000}
+
+awk -v count="$COUNT" 'BEGIN {
+  for (i = 0; i < count; i++) {
+    tid = 1000 + int(i / 16)
+    sid = 10000 + i
+    printf "Channel %d;Bench:%d:HC34M2S0:S19.2E:27500:%d=2:%d=deu@3:0:0:%d:1:%d:0\n",
+           i + 1, 10700 + (tid % 100) * 20, 101 + i % 16 * 16, 102 + i % 16 * 16, sid, tid
+  }
+}'
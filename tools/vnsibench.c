@@ -0,0 +1,450 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Benchmark client for the VNSI protocol, talking to a running VDR with
+ * the plugin over TCP or its unix domain socket. It is not part of the
+ * plugin build, see tools/Makefile.
+ *
+ *   stream: play a channel and measure the throughput and the CPU time
+ *           the server spends per Gbit
+ *   lookup: ask for the CA ids of every channel by its UID in a loop,
+ *           which measures the UID to channel lookup
+ */
+
+#include "../vnsicommand.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+// below VNSI_COMPACT_PROTOCOLVERSION, stream packets keep the fixed header
+#define BENCH_PROTOCOLVERSION 13
+
+#define HEADER_LENGTH         12
+#define STREAM_HEADER_LENGTH  40
+#define OSD_HEADER_LENGTH     36
+
+static int sock = -1;
+static uint32_t nextRequestID = 1;
+
+static double Now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double ProcessCPU(int pid)
+{
+  // utime and stime, fields 14 and 15, after the command name
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return -1;
+  char line[1024];
+  size_t len = fread(line, 1, sizeof(line) - 1, file);
+  fclose(file);
+  line[len] = 0;
+
+  const char *p = strrchr(line, ')');
+  unsigned long utime = 0, stime = 0;
+  if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+    return -1;
+  return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static double OwnCPU()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static bool ReadAll(void *buffer, size_t size)
+{
+  uint8_t *p = (uint8_t*)buffer;
+  while (size > 0)
+  {
+    ssize_t r = read(sock, p, size);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    size -= r;
+  }
+  return true;
+}
+
+static bool WriteAll(const void *buffer, size_t size)
+{
+  const uint8_t *p = (const uint8_t*)buffer;
+  while (size > 0)
+  {
+    ssize_t r = write(sock, p, size);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    size -= r;
+  }
+  return true;
+}
+
+class cRequest
+{
+public:
+  cRequest(uint32_t opcode) : m_Data(16, 0)
+  {
+    m_ID = nextRequestID++;
+    Put32(0, VNSI_CHANNEL_REQUEST_RESPONSE);
+    Put32(4, m_ID);
+    Put32(8, opcode);
+  }
+
+  void AddU32(uint32_t value) { m_Data.resize(m_Data.size() + 4); Put32(m_Data.size() - 4, value); }
+  void AddU8(uint8_t value) { m_Data.push_back(value); }
+  void AddString(const char *s) { m_Data.insert(m_Data.end(), s, s + strlen(s) + 1); }
+
+  uint32_t Send()
+  {
+    Put32(12, m_Data.size() - 16);
+    return WriteAll(m_Data.data(), m_Data.size()) ? m_ID : 0;
+  }
+
+private:
+  void Put32(size_t pos, uint32_t value)
+  {
+    value = htonl(value);
+    memcpy(&m_Data[pos], &value, 4);
+  }
+
+  std::vector<uint8_t> m_Data;
+  uint32_t m_ID;
+};
+
+static uint32_t Get32(const uint8_t *p)
+{
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return ntohl(value);
+}
+
+/*
+ * Read the next message. Returns its channel, for responses id is the
+ * request id, for stream packets the opcode. data holds the payload.
+ */
+static int ReadMessage(uint32_t &id, std::vector<uint8_t> &data)
+{
+  uint8_t header[OSD_HEADER_LENGTH];
+  if (!ReadAll(header, 4))
+    return -1;
+
+  uint32_t channel = Get32(header);
+  size_t headerLength;
+  switch (channel)
+  {
+    case VNSI_CHANNEL_REQUEST_RESPONSE:
+    case VNSI_CHANNEL_STATUS:
+    case VNSI_CHANNEL_SCAN:
+      headerLength = HEADER_LENGTH;
+      break;
+    case VNSI_CHANNEL_STREAM:
+      headerLength = STREAM_HEADER_LENGTH;
+      break;
+    case VNSI_CHANNEL_OSD:
+      headerLength = OSD_HEADER_LENGTH;
+      break;
+    default:
+      fprintf(stderr, "unexpected channel %u\n", channel);
+      return -1;
+  }
+
+  if (!ReadAll(header + 4, headerLength - 4))
+    return -1;
+  id = Get32(header + 4);
+  data.resize(Get32(header + headerLength - 4));
+  if (!data.empty() && !ReadAll(data.data(), data.size()))
+    return -1;
+  return channel;
+}
+
+static bool WaitResponse(uint32_t requestID, std::vector<uint8_t> &data)
+{
+  for (;;)
+  {
+    uint32_t id;
+    int channel = ReadMessage(id, data);
+    if (channel < 0)
+      return false;
+    if (channel == VNSI_CHANNEL_REQUEST_RESPONSE && id == requestID)
+      return true;
+  }
+}
+
+static bool Connect(const char *host, int port, const char *path)
+{
+  if (path)
+  {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+      return false;
+    strcpy(addr.sun_path, path);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    return sock >= 0 && connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+  }
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_socktype = SOCK_STREAM;
+  char service[16];
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &res) != 0)
+    return false;
+  sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  bool ok = sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen) == 0;
+  freeaddrinfo(res);
+  return ok;
+}
+
+static bool Login()
+{
+  cRequest req(VNSI_LOGIN);
+  req.AddU32(BENCH_PROTOCOLVERSION);
+  req.AddU8(0);
+  req.AddString("vnsibench");
+  std::vector<uint8_t> data;
+  uint32_t id = req.Send();
+  return id && WaitResponse(id, data) && data.size() >= 4;
+}
+
+static bool GetChannelUIDs(std::vector<uint32_t> &uids)
+{
+  cRequest req(VNSI_CHANNELS_GETCHANNELS);
+  req.AddU32(0);
+  req.AddU8(0);
+  std::vector<uint8_t> data;
+  uint32_t id = req.Send();
+  if (!id || !WaitResponse(id, data))
+    return false;
+
+  // number, name, provider, uid, caid, caids and the picon reference
+  size_t pos = 0;
+  while (pos + 4 <= data.size())
+  {
+    pos += 4;
+    for (int i = 0; i < 2; i++)
+      pos += strnlen((const char*)&data[pos], data.size() - pos) + 1;
+    if (pos + 8 > data.size())
+      break;
+    uids.push_back(Get32(&data[pos]));
+    pos += 8;
+    for (int i = 0; i < 2; i++)
+      pos += strnlen((const char*)&data[pos], data.size() - pos) + 1;
+  }
+  return true;
+}
+
+static int Stream(uint32_t channel, int seconds, int warmup, int pid)
+{
+  cRequest req(VNSI_CHANNELSTREAM_OPEN);
+  req.AddU32(channel);
+  req.AddU32(50);
+  req.AddU8(0);
+  std::vector<uint8_t> data;
+  uint32_t id = req.Send();
+  if (!id || !WaitResponse(id, data) || data.size() < 4 || Get32(data.data()) != VNSI_RET_OK)
+  {
+    fprintf(stderr, "can't open channel %u\n", channel);
+    return 1;
+  }
+
+  double start = Now();
+  double measureStart = 0;
+  double serverCPU = 0, clientCPU = 0;
+  uint64_t bytes = 0, packets = 0;
+  bool measuring = false;
+
+  for (;;)
+  {
+    double now = Now();
+    if (!measuring && now - start >= warmup)
+    {
+      measuring = true;
+      measureStart = now;
+      serverCPU = pid > 0 ? ProcessCPU(pid) : 0;
+      clientCPU = OwnCPU();
+    }
+    if (measuring && now - measureStart >= seconds)
+      break;
+
+    uint32_t opcode;
+    int ch = ReadMessage(opcode, data);
+    if (ch < 0)
+    {
+      fprintf(stderr, "connection lost\n");
+      return 1;
+    }
+    if (measuring && ch == VNSI_CHANNEL_STREAM)
+    {
+      bytes += STREAM_HEADER_LENGTH + data.size();
+      if (opcode == VNSI_STREAM_MUXPKT)
+        packets++;
+    }
+  }
+
+  double elapsed = Now() - measureStart;
+  double gbit = bytes * 8 / 1e9;
+  printf("received %llu bytes in %llu packets in %.1f s: %.1f Mbit/s\n",
+         (unsigned long long)bytes, (unsigned long long)packets, elapsed, gbit * 1000 / elapsed);
+  printf("client CPU: %.3f s, %.3f s per Gbit\n", OwnCPU() - clientCPU, gbit > 0 ? (OwnCPU() - clientCPU) / gbit : 0);
+  if (pid > 0)
+  {
+    double cpu = ProcessCPU(pid) - serverCPU;
+    printf("server CPU: %.3f s, %.3f s per Gbit\n", cpu, gbit > 0 ? cpu / gbit : 0);
+  }
+  return 0;
+}
+
+static int Lookup(int seconds)
+{
+  std::vector<uint32_t> uids;
+  if (!GetChannelUIDs(uids) || uids.empty())
+  {
+    fprintf(stderr, "no channels\n");
+    return 1;
+  }
+
+  std::vector<uint8_t> data;
+  uint64_t requests = 0;
+  double total = 0, worst = 0;
+  double start = Now();
+  while (Now() - start < seconds)
+  {
+    for (uint32_t uid : uids)
+    {
+      double sent = Now();
+      cRequest req(VNSI_CHANNELS_GETCAIDS);
+      req.AddU32(uid);
+      uint32_t id = req.Send();
+      if (!id || !WaitResponse(id, data))
+      {
+        fprintf(stderr, "connection lost\n");
+        return 1;
+      }
+      double latency = Now() - sent;
+      total += latency;
+      if (latency > worst)
+        worst = latency;
+      requests++;
+    }
+  }
+
+  double elapsed = Now() - start;
+  printf("%zu channels, %llu lookups in %.1f s: %.0f per second, mean %.1f us, max %.1f us\n",
+         uids.size(), (unsigned long long)requests, elapsed, requests / elapsed,
+         total / requests * 1e6, worst * 1e6);
+  return 0;
+}
+
+static void Usage()
+{
+  fprintf(stderr,
+          "usage: vnsibench [options] stream|lookup\n"
+          "  -h host     server, default 127.0.0.1\n"
+          "  -p port     TCP port, default 34890\n"
+          "  -u path     connect to the unix domain socket instead\n"
+          "  -c channel  channel number or UID to stream, default 1\n"
+          "  -t seconds  measured time, default 20\n"
+          "  -w seconds  warm-up before measuring, default 2\n"
+          "  -P pid      VDR's pid, to report the server's CPU time\n");
+}
+
+int main(int argc, char *argv[])
+{
+  const char *host = "127.0.0.1";
+  const char *path = NULL;
+  int port = 34890;
+  uint32_t channel = 1;
+  int seconds = 20;
+  int warmup = 2;
+  int pid = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "h:p:u:c:t:w:P:")) != -1)
+  {
+    switch (c)
+    {
+      case 'h': host = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 'u': path = optarg; break;
+      case 'c': channel = strtoul(optarg, NULL, 0); break;
+      case 't': seconds = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      case 'P': pid = atoi(optarg); break;
+      default: Usage(); return 2;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    Usage();
+    return 2;
+  }
+
+  if (!Connect(host, port, path))
+  {
+    perror("connect");
+    return 1;
+  }
+  if (!Login())
+  {
+    fprintf(stderr, "login failed\n");
+    return 1;
+  }
+
+  if (strcmp(argv[optind], "stream") == 0)
+    return Stream(channel, seconds, warmup, pid);
+  if (strcmp(argv[optind], "lookup") == 0)
+    return Lookup(seconds);
+  Usage();
+  return 2;
+}
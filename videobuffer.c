@@ -52,7 +52,8 @@ protected:
 cVideoBufferSimple::cVideoBufferSimple()
   :m_Buffer(MEGABYTE(5), TS_SIZE * 2, false)
 {
-  m_Buffer.SetTimeouts(0, 100);
+  // the reader blocks on the event signalled by cVideoInput
+  m_Buffer.SetTimeouts(0, 0);
   m_BytesConsumed = 0;
 }
 
@@ -72,7 +73,6 @@ int cVideoBufferSimple::ReadBlock(uint8_t **buf, unsigned int size, time_t &endT
   *buf = m_Buffer.Get(readBytes);
   if (!(*buf) || readBytes < TS_SIZE)
   {
-    usleep(100);
     return 0;
   }
   /* Make sure we are looking at a TS packet */
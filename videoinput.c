@@ -479,6 +479,10 @@ std::shared_ptr<cDummyReceiver> cDummyReceiver::Create(cDevice *device)
 
 // ----------------------------------------------------------------------------
 
+// thresholds for waking the demuxer on received data
+#define WAKEUP_BYTES (TS_SIZE * 16)
+#define WAKEUP_MS    2
+
 cVideoInput::cVideoInput(cCondWait &event)
   : m_Event(event)
   , m_RetuneRequested(false)
@@ -491,6 +495,8 @@ cVideoInput::cVideoInput(cCondWait &event)
   m_VideoBuffer = NULL;
   m_Priority = 0;
   m_DataSeen = false;
+  m_PendingArmed = false;
+  m_PendingSince = 0;
 }
 
 cVideoInput::~cVideoInput()
@@ -505,6 +511,7 @@ bool cVideoInput::Open(const cChannel *channel, int priority, cVideoBuffer *vide
   m_Priority = priority;
   m_RetuneRequested = false;
   m_DataSeen = false;
+  m_PendingArmed = false;
   m_Device = cDevice::GetDevice(m_Channel, m_Priority, false);
   m_camSlot = nullptr;
 
@@ -645,6 +652,48 @@ inline void cVideoInput::Receive(const uchar *data, int length)
      m_DataSeen = true;
   }
   m_VideoBuffer->Put(data, length);
+
+  // wake the reader once about a packet's worth of data is pending or
+  // the oldest of it is 2 ms old, rather than for every TS packet. The
+  // first pending data wakes it too, to arm its timer for the 2 ms
+  uint64_t now = cTimeMs::Now();
+  if (!m_PendingArmed.exchange(true))
+  {
+    m_PendingSince = now;
+    m_PendingBytes = 0;
+    m_Event.Signal();
+  }
+  m_PendingBytes += length;
+  if (m_PendingBytes >= WAKEUP_BYTES || now - m_PendingSince >= WAKEUP_MS)
+  {
+    m_PendingArmed = false;
+    m_Event.Signal();
+  }
+}
+
+int cVideoInput::WakeupTimeout(int idleMs)
+{
+  if (!m_PendingArmed)
+    return idleMs;
+
+  // the data that armed the timer is due, take over from the receiver
+  // if nothing more arrives to trigger the wakeup
+  int64_t remaining = WAKEUP_MS - (int64_t)(cTimeMs::Now() - m_PendingSince);
+  if (remaining <= 0)
+  {
+    m_PendingArmed = false;
+    return 0;
+  }
+  return remaining;
+}
+
+void cVideoInput::SetPriority(int priority)
+{
+  m_Priority = priority;
+#if VDRVERSNUM >= 20107
+  if (m_Receiver)
+    m_Receiver->SetPriority(priority);
+#endif
 }
 
 void cVideoInput::RequestRetune()
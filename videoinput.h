@@ -46,9 +46,20 @@ public:
   bool Open(const cChannel *channel, int priority, cVideoBuffer *videoBuffer);
   void Close();
   bool IsOpen();
+  int GetPriority() { return m_Priority; }
+  /*!
+   * Change the priority of the receiver, for the device to weigh it
+   * against other users.
+   */
+  void SetPriority(int priority);
   void RequestRetune();
   enum eReceivingStatus {NORMAL, RETUNE, CLOSE};
   eReceivingStatus ReceivingStatus();
+  /*!
+   * How long the reader may sleep: idleMs while nothing is pending,
+   * otherwise until the pending data is due, 0 if it is already.
+   */
+  int WakeupTimeout(int idleMs);
 protected:
   cChannel *PmtChannel();
   void Receive(const uchar *data, int length);
@@ -64,4 +75,7 @@ protected:
   cCondWait &m_Event;
   std::shared_ptr<cDummyReceiver> m_DummyReceiver;
   std::atomic<bool> m_RetuneRequested;
+  unsigned int m_PendingBytes = 0;          /*!> Received since the reader was last woken */
+  std::atomic<uint64_t> m_PendingSince;
+  std::atomic<bool> m_PendingArmed;         /*!> Data waits for the reader's timer */
 };
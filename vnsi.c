@@ -41,9 +41,18 @@ cPluginVNSIServer::cPluginVNSIServer(void)
 const char *cPluginVNSIServer::CommandLineHelp(void)
 {
     return "  -t n, --timeout=n      stream data timeout in seconds (default: 10)\n"
+           "  -w n, --write-timeout=n drop clients not reading for n seconds (default: 10, 0: never)\n"
            "  -d  , --device         act as the primary device\n"
            "  -s n, --test=n         TS stream test file to simulate as channel\n"
-           "  -p n, --port=n         tcp port to listen on\n";
+           "  -p n, --port=n         tcp port to listen on\n"
+           "  -u p, --unix=p         also listen on the unix domain socket p\n"
+           "  -m n, --unix-mode=n    permissions of the unix domain socket (default: 0660)\n"
+           "  -b n, --batch-window=n milliseconds to batch mux packets for clients (default: 10)\n"
+           "  -Z  , --no-zerocopy    copy all stream data to the socket\n"
+           "  -r n, --uplink=n       pace streaming clients to share n kbit/s (default: 0, off)\n"
+           "  -c n, --max-clients=n  refuse connections above n clients (default: 0, no limit)\n"
+           "  -l n, --max-live=n     refuse live streams above n (default: 0, no limit)\n"
+           "  -R n, --max-recordings=n refuse recording streams above n (default: 0, no limit)\n";
 }
 
 bool cPluginVNSIServer::ProcessArgs(int argc, char *argv[])
@@ -52,21 +61,48 @@ bool cPluginVNSIServer::ProcessArgs(int argc, char *argv[])
   static struct option long_options[] = {
        { "port",     required_argument, NULL, 'p' },
        { "timeout",  required_argument, NULL, 't' },
+       { "write-timeout", required_argument, NULL, 'w' },
        { "device",   no_argument,       NULL, 'd' },
        { "test",     required_argument, NULL, 'T' },
+       { "unix",     required_argument, NULL, 'u' },
+       { "unix-mode", required_argument, NULL, 'm' },
+       { "batch-window", required_argument, NULL, 'b' },
+       { "no-zerocopy", no_argument,    NULL, 'Z' },
+       { "uplink",   required_argument, NULL, 'r' },
+       { "max-clients", required_argument, NULL, 'c' },
+       { "max-live", required_argument, NULL, 'l' },
+       { "max-recordings", required_argument, NULL, 'R' },
        { NULL,       no_argument,       NULL,  0  }
      };
 
   int c;
 
-  while ((c = getopt_long(argc, argv, "t:dT:p:", long_options, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "t:w:dT:p:u:m:b:Zr:c:l:R:", long_options, NULL)) != -1) {
         switch (c) {
           case 'p': if(optarg != NULL) VNSIServerConfig.listen_port = atoi(optarg);
                     break;
           case 't': if(optarg != NULL) VNSIServerConfig.stream_timeout = atoi(optarg);
                     break;
+          case 'w': if(optarg != NULL) VNSIServerConfig.write_timeout = atoi(optarg);
+                    break;
           case 'd': VNSIServerConfig.device = true;
                     break;
+          case 'u': if(optarg != NULL) VNSIServerConfig.socket_path = optarg;
+                    break;
+          case 'm': if(optarg != NULL) VNSIServerConfig.socket_mode = strtol(optarg, NULL, 8);
+                    break;
+          case 'b': if(optarg != NULL) VNSIServerConfig.batch_window = atoi(optarg);
+                    break;
+          case 'Z': VNSIServerConfig.zerocopy = false;
+                    break;
+          case 'r': if(optarg != NULL) VNSIServerConfig.uplink_rate = strtoul(optarg, NULL, 10);
+                    break;
+          case 'c': if(optarg != NULL) VNSIServerConfig.max_clients = atoi(optarg);
+                    break;
+          case 'l': if(optarg != NULL) VNSIServerConfig.max_live = atoi(optarg);
+                    break;
+          case 'R': if(optarg != NULL) VNSIServerConfig.max_recordings = atoi(optarg);
+                    break;
           case 'T': if(optarg != NULL) {
                     VNSIServerConfig.testStreamFile = optarg;
 
@@ -181,12 +217,28 @@ bool cPluginVNSIServer::Service(const char *Id, void *Data)
 const char **cPluginVNSIServer::SVDRPHelpPages(void)
 {
   // Return help text for SVDRP commands this plugin implements
-  return NULL;
+  static const char *HelpPages[] =
+  {
+    "STAT\n"
+    "    Show the connected clients and the stream queues of those\n"
+    "    currently streaming (queued frames and bytes, dropped frames).",
+    NULL
+  };
+  return HelpPages;
 }
 
 cString cPluginVNSIServer::SVDRPCommand(const char *Command, const char *Option, int &ReplyCode)
 {
   // Process SVDRP commands this plugin implements
+  if (strcasecmp(Command, "STAT") == 0)
+  {
+    if (!Server)
+    {
+      ReplyCode = 550;
+      return "VNSI server not running";
+    }
+    return Server->GetStats();
+  }
   return NULL;
 }
 
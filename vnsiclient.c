@@ -31,16 +31,23 @@
 #include "streamer.h"
 #include "vnsiserver.h"
 #include "recplayer.h"
+#include "recpusher.h"
+#include "shmring.h"
+#include "pacer.h"
 #include "vnsiosd.h"
 #include "requestpacket.h"
 #include "responsepacket.h"
 #include "hash.h"
 #include "channelfilter.h"
+#include "channelcache.h"
 #include "channelscancontrol.h"
 #include <sys/types.h>
 #include <dirent.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <zlib.h>
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <string>
@@ -55,6 +62,46 @@
 
 cMutex cVNSIClient::m_timerLock;
 bool cVNSIClient::m_inhibidDataUpdates = false;
+std::atomic<int> cVNSIClient::m_LiveStreams(0);
+std::atomic<int> cVNSIClient::m_RecordingStreams(0);
+
+// requests of a client may run on several threads at once
+static cCharSetConv &ToUTF8()
+{
+  static thread_local cCharSetConv toUTF8;
+  return toUTF8;
+}
+
+#if VDRVERSNUM >= 20301
+// the state of VDR's lists as seen by any client, a list takes a new
+// serial when its state key reports a change
+namespace
+{
+struct sListState
+{
+  cStateKey key;
+  uint64_t serial = 0;
+};
+
+cMutex listStateMutex;
+uint64_t listStateSerial = 0;
+sListState channelsState;
+sListState timersState;
+sListState recordingsState;
+int vnsiTimersState = 0;
+uint64_t vnsiTimersSerial = 0;
+
+uint64_t ListChanged(sListState &state, bool changed)
+{
+  if (changed)
+  {
+    state.key.Remove(false);
+    state.serial = ++listStateSerial;
+  }
+  return state.serial;
+}
+}
+#endif
 
 cVNSIClient::cVNSIClient(int fd, unsigned int id, const char *ClientAdr, CVNSITimers &timers)
   : m_Id(id),
@@ -66,7 +113,21 @@ cVNSIClient::cVNSIClient(int fd, unsigned int id, const char *ClientAdr, CVNSITi
   SetDescription("VNSI Client %u->%s", id, ClientAdr);
 
   m_StatusInterfaceEnabled = false;
+  m_Connected = true;
+  m_capabilities = 0;
+  m_compressedIn = 0;
+  m_compressedOut = 0;
+  m_compressUsec = 0;
+  m_StatusFlags = 0;
+  m_StatusEvents = nullptr;
+  m_StatusCount = 0;
+  if (cPacer::Enabled() && !m_socket.IsLocal())
+    m_Pacer.reset(new cPacer(m_socket));
+  m_StreamStats.reset(new sStreamStats);
+#ifndef __linux__
+  // elsewhere the requests are read by cVNSIReactor
   Start();
+#endif
 }
 
 cVNSIClient::~cVNSIClient()
@@ -76,12 +137,22 @@ cVNSIClient::~cVNSIClient()
   m_ChannelScanControl.StopScan();
   m_socket.Shutdown();
   Cancel(10);
+  delete m_RecPusher;
+  delete m_RecPlayer;
+  if (m_RecordingSlot)
+    m_RecordingStreams--;
+  for (sStatusEvent *event = m_StatusEvents.exchange(nullptr); event; )
+  {
+    sStatusEvent *next = event->next;
+    delete event;
+    event = next;
+  }
   DEBUGLOG("done");
 }
 
 void cVNSIClient::Action(void)
 {
-  uint32_t channelID;
+  cRequestBuffer buffer;
   uint32_t requestID;
   uint32_t opcode;
   uint32_t dataLength;
@@ -89,161 +160,321 @@ void cVNSIClient::Action(void)
 
   while (Running())
   {
-    if (!m_socket.read((uint8_t*)&channelID, sizeof(uint32_t)))
-      break;
-
-    channelID = ntohl(channelID);
-    if (channelID == 1)
+    cRequestBuffer::eResult result;
+    while ((result = buffer.Next(requestID, opcode, data, dataLength)) == cRequestBuffer::REQUEST)
     {
-      if (!m_socket.read((uint8_t*)&requestID, sizeof(uint32_t), 10000))
-        break;
-
-      requestID = ntohl(requestID);
+      DEBUGLOG("Received chan=1, ser=%u, op=%u, edl=%u", requestID, opcode, dataLength);
 
-      if (!m_socket.read((uint8_t*)&opcode, sizeof(uint32_t), 10000))
-        break;
-
-      opcode = ntohl(opcode);
-
-      if (!m_socket.read((uint8_t*)&dataLength, sizeof(uint32_t), 10000))
+      if (!HandleRequest(requestID, opcode, data, dataLength))
         break;
+    }
+    if (result != cRequestBuffer::NEED_MORE)
+      break;
 
-      dataLength = ntohl(dataLength);
-      if (dataLength > 200000) // a random sanity limit
-      {
-        ERRORLOG("dataLength > 200000!");
-        break;
-      }
+    ssize_t p = m_socket.readsome(buffer.WritePtr(), buffer.WriteSpace());
+    if (p <= 0)
+      break;
+    buffer.Written(p);
+  }
 
-      if (dataLength)
-      {
-        try
-        {
-          data = new uint8_t[dataLength];
-        }
-        catch (const std::bad_alloc &)
-        {
-          ERRORLOG("Extra data buffer malloc error");
-          break;
-        }
+  // If thread is ended due to closed connection delete a
+  // possible running stream here
+  Disconnected();
+}
 
-        if (!m_socket.read(data, dataLength, 10000))
-        {
-          ERRORLOG("Could not read data");
-          free(data);
-          break;
-        }
-      }
-      else
-      {
-        data = NULL;
-      }
+bool cVNSIClient::HandleRequest(uint32_t requestID, uint32_t opcode, uint8_t *data, uint32_t dataLength)
+{
+  if (!m_loggedIn && (opcode != VNSI_LOGIN))
+  {
+    ERRORLOG("Clients must be logged in before sending commands! Aborting.");
+    delete[] data;
+    return false;
+  }
 
-      DEBUGLOG("Received chan=%u, ser=%u, op=%u, edl=%u", channelID, requestID, opcode, dataLength);
+  if (opcode == VNSI_INVALIDATESOCKET)
+  {
+    cRequestPacket req(requestID, opcode, data, dataLength);
+    process_InvalidateSocket(req);
+    return false;
+  }
 
-      if (!m_loggedIn && (opcode != VNSI_LOGIN))
-      {
-        ERRORLOG("Clients must be logged in before sending commands! Aborting.");
-        if (data)
-          free(data);
-        break;
-      }
+  try
+  {
+    cRequestPacket req(requestID, opcode, data, dataLength);
 
-      if (opcode == VNSI_INVALIDATESOCKET)
-      {
-        cRequestPacket req(requestID, opcode, data, dataLength);
-        process_InvalidateSocket(req);
-        break;
-      }
+    // build the response in a buffer as large as the last one of the
+    // opcode
+    if (opcode < MAX_SIZE_HINTS)
+      cResponsePacket::SetSizeHint(m_responseSizes[opcode]);
 
-      try
-      {
-        cRequestPacket req(requestID, opcode, data, dataLength);
-        processRequest(req);
-      }
-      catch (const std::exception &e)
-      {
-        ERRORLOG("%s", e.what());
-        break;
-      }
-    }
+    if (IsConcurrent(opcode))
+      processConcurrentRequest(req);
     else
-    {
-      ERRORLOG("Incoming channel number unknown");
-      break;
-    }
+      processRequest(req);
+
+    if (opcode < MAX_SIZE_HINTS)
+      m_responseSizes[opcode] = cResponsePacket::GetHighWater();
+  }
+  catch (const std::exception &e)
+  {
+    ERRORLOG("%s", e.what());
+    return false;
   }
+  return true;
+}
 
-  // If thread is ended due to closed connection delete a
-  // possible running stream here
-  StopChannelStreaming();
-  m_ChannelScanControl.StopScan();
+void cVNSIClient::Disconnected()
+{
+  {
+    cMutexLock lock(&m_msgLock);
+    StopChannelStreaming();
+    m_ChannelScanControl.StopScan();
 
-  // Shutdown OSD
-  delete m_Osd;
-  m_Osd = NULL;
+    // Shutdown OSD
+    delete m_Osd;
+    m_Osd = NULL;
+  }
+  m_Connected = false;
 }
 
 bool cVNSIClient::StartChannelStreaming(cResponsePacket &resp, const cChannel *channel, int32_t priority, uint8_t timeshift, uint32_t timeout)
 {
   delete m_Streamer;
   m_Streamer = new cLiveStreamer(m_Id, m_bSupportRDS, m_protocolVersion, timeshift, timeout);
+  if (m_Ring)
+    m_Streamer->SetRing(m_Ring);
+  if (m_capabilities & VNSI_CAP_MUXBATCH)
+    m_Streamer->SetBatchWindow(VNSIServerConfig.batch_window);
+  m_Streamer->SetPacer(m_Pacer.get());
+  m_Streamer->SetStats(m_StreamStats.get());
   m_isStreaming = m_Streamer->StreamChannel(channel, priority, &m_socket, &resp);
+  m_StreamStats->active = m_isStreaming;
   return m_isStreaming;
 }
 
 void cVNSIClient::StopChannelStreaming()
 {
   m_isStreaming = false;
+  m_StreamStats->active = false;
   delete m_Streamer;
   m_Streamer = NULL;
+  if (m_Pacer)
+    m_Pacer->SetDemand(cPacer::LIVE, 0);
+  if (m_LiveSlot)
+  {
+    m_LiveStreams--;
+    m_LiveSlot = false;
+  }
 }
 
-void cVNSIClient::SignalTimerChange()
+bool cVNSIClient::AcquireSlot(std::atomic<int> &count, int limit)
 {
-  cMutexLock lock(&m_msgLock);
+  int current = count;
+  do
+  {
+    if (limit > 0 && current >= limit)
+      return false;
+  } while (!count.compare_exchange_weak(current, current + 1));
+  return true;
+}
 
-  if (m_StatusInterfaceEnabled)
+cString cVNSIClient::GetStats()
+{
+  // called by the status thread, everything read here is atomic or
+  // locked on its own
+  cString compressed("");
+  if (m_compressedIn > 0)
+    compressed = cString::sprintf(", compressed %llu to %llu bytes in %llu ms",
+                                  (unsigned long long)m_compressedIn, (unsigned long long)m_compressedOut,
+                                  (unsigned long long)m_compressUsec / 1000);
+
+  cString pacing("");
+  if (m_Pacer)
+  {
+    uint64_t achieved, target;
+    m_Pacer->GetRates(achieved, target);
+    pacing = cString::sprintf(", sent %llu of %llu kbit/s", (unsigned long long)achieved * 8 / 1000,
+                              (unsigned long long)target * 8 / 1000);
+  }
+
+  const sStreamStats &s = *m_StreamStats;
+  if (s.active)
+    return cString::sprintf("client %u %s: %s queue %u frames %zu bytes dropped %u%s%s", m_Id, *m_ClientAddress,
+                            s.shared ? "shared" : "private", s.frames.load(), s.bytes.load(), s.dropped.load(),
+                            *compressed, *pacing);
+  return cString::sprintf("client %u %s: idle%s%s", m_Id, *m_ClientAddress, *compressed, *pacing);
+}
+
+void cVNSIClient::SendResponse(cResponsePacket &resp)
+{
+  if (!(m_capabilities & VNSI_CAP_COMPRESS) ||
+      resp.getLen() - resp.getHeaderLength() < COMPRESS_MIN_SIZE)
   {
-    cResponsePacket resp;
-    resp.initStatus(VNSI_STATUS_TIMERCHANGE);
-    resp.finalise();
     m_socket.write(resp.getPtr(), resp.getLen());
+    return;
   }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+  cResponsePacket compressed;
+  bool ok = resp.compress(compressed, Z_BEST_SPEED);
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+  m_compressUsec += (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000;
+
+  // not worth it for data that does not compress
+  if (!ok || compressed.getLen() >= resp.getLen())
+  {
+    m_socket.write(resp.getPtr(), resp.getLen());
+    return;
+  }
+
+  m_compressedIn += resp.getLen();
+  m_compressedOut += compressed.getLen();
+  m_socket.write(compressed.getPtr(), compressed.getLen());
 }
 
-void cVNSIClient::ChannelsChange()
+void cVNSIClient::SetStatusWakeup(std::function<void()> wakeup)
 {
-  cMutexLock lock(&m_msgLock);
+  {
+    cMutexLock lock(&m_WakeupMutex);
+    m_StatusWakeup = wakeup;
+  }
+  WakeStatus();
+}
+
+void cVNSIClient::QueueStatus(cResponsePacket &resp)
+{
+  // a client that does not read its socket must not grow the queue
+  // without bound, the newest are dropped
+  if (m_StatusCount.fetch_add(1) >= MAX_STATUS_EVENTS)
+  {
+    m_StatusCount--;
+    DEBUGLOG("client %u: status queue full, dropping message", m_Id);
+    return;
+  }
+
+  sStatusEvent *event = new sStatusEvent;
+  event->flag = 0;
+  event->data.assign((const char*)resp.getPtr(), resp.getLen());
+  PushStatus(event);
+}
+
+void cVNSIClient::QueueStatusFlag(uint32_t flag)
+{
+  // already pending, the client is told once
+  if (m_StatusFlags.fetch_or(flag) & flag)
+    return;
+
+  // queued like the messages with data, so it is sent in order with them
+  sStatusEvent *event = new sStatusEvent;
+  event->flag = flag;
+  PushStatus(event);
+}
+
+void cVNSIClient::PushStatus(sStatusEvent *event)
+{
+  event->next = m_StatusEvents;
+  while (!m_StatusEvents.compare_exchange_weak(event->next, event))
+    ;
+  WakeStatus();
+}
+
+void cVNSIClient::WakeStatus()
+{
+  std::function<void()> wakeup;
+  {
+    cMutexLock lock(&m_WakeupMutex);
+    wakeup = m_StatusWakeup;
+  }
+  if (wakeup)
+    wakeup();
+  else
+    FlushStatus();
+}
 
+void cVNSIClient::FlushStatus()
+{
+  // only keeps concurrent flushes in order, each message is a single
+  // write and does not mix with responses. VDR's callbacks take m_msgLock,
+  // it must not be held while writing to a slow client
+  cMutexLock lock(&m_FlushMutex);
+
+  // the stack has the newest first
+  sStatusEvent *events = nullptr;
+  for (sStatusEvent *event = m_StatusEvents.exchange(nullptr); event; )
+  {
+    sStatusEvent *next = event->next;
+    event->next = events;
+    events = event;
+    event = next;
+  }
+
+  static const struct
+  {
+    uint32_t flag;
+    uint32_t opcode;
+  } notifications[] =
+  {
+    { STATUS_TIMERCHANGE, VNSI_STATUS_TIMERCHANGE },
+    { STATUS_CHANNELCHANGE, VNSI_STATUS_CHANNELCHANGE },
+    { STATUS_RECORDINGSCHANGE, VNSI_STATUS_RECORDINGSCHANGE }
+  };
+
+  while (events)
+  {
+    sStatusEvent *next = events->next;
+    if (events->flag)
+    {
+      // a change from now on needs a notification of its own
+      m_StatusFlags.fetch_and(~events->flag);
+      for (const auto &n : notifications)
+      {
+        if (n.flag != events->flag)
+          continue;
+        cResponsePacket resp;
+        resp.initStatus(n.opcode);
+        resp.finalise();
+        m_socket.write(resp.getPtr(), resp.getLen());
+      }
+    }
+    else
+    {
+      m_socket.write(events->data.data(), events->data.size());
+      m_StatusCount--;
+    }
+    delete events;
+    events = next;
+  }
+}
+
+void cVNSIClient::SignalTimerChange()
+{
+  if (m_StatusInterfaceEnabled)
+    QueueStatusFlag(STATUS_TIMERCHANGE);
+}
+
+void cVNSIClient::ChannelsChange()
+{
   if (!m_StatusInterfaceEnabled)
     return;
 
-  cResponsePacket resp;
-  resp.initStatus(VNSI_STATUS_CHANNELCHANGE);
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+  QueueStatusFlag(STATUS_CHANNELCHANGE);
 }
 
 void cVNSIClient::RecordingsChange()
 {
-  cMutexLock lock(&m_msgLock);
-
   if (!m_StatusInterfaceEnabled)
     return;
 
-  cResponsePacket resp;
-  resp.initStatus(VNSI_STATUS_RECORDINGSCHANGE);
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+  QueueStatusFlag(STATUS_RECORDINGSCHANGE);
 }
 
 int cVNSIClient::EpgChange()
 {
   int callAgain = 0;
 
-  cMutexLock lock(&m_msgLock);
-
   if (!m_StatusInterfaceEnabled)
     return callAgain;
 
@@ -283,22 +514,25 @@ int cVNSIClient::EpgChange()
       continue;
 
     uint32_t channelId = CreateStringHash(schedule->ChannelID().ToString());
-    auto it = m_epgUpdate.find(channelId);
-    if (it == m_epgUpdate.end() || it->second.attempts > 3 ||
-        it->second.lastEvent >= lastEvent->StartTime())
     {
-      continue;
-    }
+      cMutexLock epgLock(&m_epgLock);
+      auto it = m_epgUpdate.find(channelId);
+      if (it == m_epgUpdate.end() || it->second.attempts > 3 ||
+          it->second.lastEvent >= lastEvent->StartTime())
+      {
+        continue;
+      }
 
-    time_t now = time(nullptr);
-    if ((now - it->second.lastTrigger) < 5)
-    {
-      callAgain = VNSI_EPG_PAUSE;
-      continue;
-    }
+      time_t now = time(nullptr);
+      if ((now - it->second.lastTrigger) < 5)
+      {
+        callAgain = VNSI_EPG_PAUSE;
+        continue;
+      }
 
-    it->second.attempts++;
-    it->second.lastTrigger = now;
+      it->second.attempts++;
+      it->second.lastTrigger = now;
+    }
 
     DEBUGLOG("Trigger EPG update for channel %s, id: %d", channel->Name(), channelId);
 
@@ -306,7 +540,7 @@ int cVNSIClient::EpgChange()
     resp.initStatus(VNSI_STATUS_EPGCHANGE);
     resp.add_U32(channelId);
     resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
+    QueueStatus(resp);
 
     callAgain = VNSI_EPG_AGAIN;
     break;
@@ -338,7 +572,7 @@ void cVNSIClient::Recording(const cDevice *Device, const char *Name, const char
       resp.add_String("");
 
     resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
+    QueueStatus(resp);
   }
 }
 
@@ -376,7 +610,7 @@ void cVNSIClient::OsdStatusMessage(const char *Message)
     resp.add_U32(0);
     resp.add_String(Message);
     resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
+    QueueStatus(resp);
   }
 }
 
@@ -391,6 +625,93 @@ void cVNSIClient::ChannelChange(const cChannel *Channel)
 }
 #endif
 
+bool cVNSIClient::IsConcurrent(uint32_t opcode) const
+{
+  if (!(m_capabilities & VNSI_CAP_OUTOFORDER))
+    return false;
+
+  // requests only reading VDR's lists, they need no client state and are
+  // answered as they complete
+  switch (opcode)
+  {
+    case VNSI_GETTIME:
+    case VNSI_PING:
+    case VNSI_CHANNELS_GETCOUNT:
+    case VNSI_CHANNELS_GETCHANNELS:
+    case VNSI_EPG_GETFORCHANNEL:
+    case VNSI_EPG_GETBULK:
+    case VNSI_RECORDINGS_DISKSIZE:
+    case VNSI_RECORDINGS_GETCOUNT:
+    case VNSI_RECORDINGS_GETLIST:
+    case VNSI_RECORDINGS_GETEDL:
+    case VNSI_RECORDINGS_DELETED_GETCOUNT:
+    case VNSI_RECORDINGS_DELETED_GETLIST:
+    case VNSI_TIMER_GETCOUNT:
+    case VNSI_TIMER_GET:
+    case VNSI_TIMER_GETLIST:
+    case VNSI_TIMER_GETTYPES:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+bool cVNSIClient::processConcurrentRequest(cRequestPacket &req)
+{
+  switch(req.getOpCode())
+  {
+    case VNSI_GETTIME:
+      return process_GetTime(req);
+
+    case VNSI_PING:
+      return process_Ping(req);
+
+    case VNSI_CHANNELS_GETCOUNT:
+      return processCHANNELS_ChannelsCount(req);
+
+    case VNSI_CHANNELS_GETCHANNELS:
+      return processCHANNELS_GetChannels(req);
+
+    case VNSI_EPG_GETFORCHANNEL:
+      return processEPG_GetForChannel(req);
+
+    case VNSI_EPG_GETBULK:
+      return processEPG_GetBulk(req);
+
+    case VNSI_RECORDINGS_DISKSIZE:
+      return processRECORDINGS_GetDiskSpace(req);
+
+    case VNSI_RECORDINGS_GETCOUNT:
+      return processRECORDINGS_GetCount(req);
+
+    case VNSI_RECORDINGS_GETLIST:
+      return processRECORDINGS_GetList(req);
+
+    case VNSI_RECORDINGS_GETEDL:
+      return processRECORDINGS_GetEdl(req);
+
+    case VNSI_RECORDINGS_DELETED_GETCOUNT:
+      return processRECORDINGS_DELETED_GetCount(req);
+
+    case VNSI_RECORDINGS_DELETED_GETLIST:
+      return processRECORDINGS_DELETED_GetList(req);
+
+    case VNSI_TIMER_GETCOUNT:
+      return processTIMER_GetCount(req);
+
+    case VNSI_TIMER_GET:
+      return processTIMER_Get(req);
+
+    case VNSI_TIMER_GETLIST:
+      return processTIMER_GetList(req);
+
+    case VNSI_TIMER_GETTYPES:
+      return processTIMER_GetTypes(req);
+  }
+  return false;
+}
+
 bool cVNSIClient::processRequest(cRequestPacket &req)
 {
   cMutexLock lock(&m_msgLock);
@@ -427,6 +748,10 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = process_GetSocket(req);
       break;
 
+    case VNSI_SESSION_BOOTSTRAP:
+      result = process_SessionBootstrap(req);
+      break;
+
     /** OPCODE 20 - 39: VNSI network functions for live streaming */
     case VNSI_CHANNELSTREAM_OPEN:
       result = processChannelStream_Open(req);
@@ -448,6 +773,10 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = processChannelStream_StatusRequest(req);
       break;
 
+    case VNSI_CHANNELSTREAM_SHM:
+      result = processChannelStream_Shm(req);
+      break;
+
     /** OPCODE 40 - 59: VNSI network functions for recording streaming */
     case VNSI_RECSTREAM_OPEN:
       result = processRecStream_Open(req);
@@ -477,6 +806,18 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = processRecStream_GetLength(req);
       break;
 
+    case VNSI_RECSTREAM_PUSH:
+      result = processRecStream_Push(req);
+      break;
+
+    case VNSI_RECSTREAM_CREDIT:
+      result = processRecStream_Credit(req);
+      break;
+
+    case VNSI_RECSTREAM_SEEK:
+      result = processRecStream_Seek(req);
+      break;
+
 
     /** OPCODE 60 - 79: VNSI network functions for channel access */
     case VNSI_CHANNELS_GETCOUNT:
@@ -519,6 +860,10 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = processCHANNELS_SetBlacklist(req);
       break;
 
+    case VNSI_CHANNELS_GETCHANGES:
+      result = processCHANNELS_GetChanges(req);
+      break;
+
     /** OPCODE 80 - 99: VNSI network functions for timer access */
     case VNSI_TIMER_GETCOUNT:
       result = processTIMER_GetCount(req);
@@ -548,6 +893,10 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = processTIMER_GetTypes(req);
       break;
 
+    case VNSI_TIMER_GETCHANGES:
+      result = processTIMER_GetChanges(req);
+      break;
+
     /** OPCODE 100 - 119: VNSI network functions for recording access */
     case VNSI_RECORDINGS_DISKSIZE:
       result = processRECORDINGS_GetDiskSpace(req);
@@ -573,12 +922,20 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = processRECORDINGS_GetEdl(req);
       break;
 
+    case VNSI_RECORDINGS_GETCHANGES:
+      result = processRECORDINGS_GetChanges(req);
+      break;
+
 
     /** OPCODE 120 - 139: VNSI network functions for epg access and manipulating */
     case VNSI_EPG_GETFORCHANNEL:
       result = processEPG_GetForChannel(req);
       break;
 
+    case VNSI_EPG_GETBULK:
+      result = processEPG_GetBulk(req);
+      break;
+
 
     /** OPCODE 140 - 159: VNSI network functions for channel scanning */
     case VNSI_SCAN_SUPPORTED:
@@ -659,6 +1016,14 @@ bool cVNSIClient::process_Login(cRequestPacket &req) /* OPCODE 1 */
                            req.extract_U8();
   const char *clientName = req.extract_String();
 
+  // older clients end here
+  bool sentCapabilities = !req.end();
+  uint32_t capabilities = 0;
+  if (sentCapabilities)
+    capabilities = req.extract_U32() & (VNSI_CAP_OUTOFORDER | VNSI_CAP_RECPUSH | VNSI_CAP_COMPRESS | VNSI_CAP_CHANGES |
+                                         VNSI_CAP_EPGBULK | VNSI_CAP_SHMSTREAM | VNSI_CAP_MUXBATCH |
+                                         VNSI_CAP_BOOTSTRAP);
+
   INFOLOG("Welcome client '%s' with protocol version '%u'", clientName, m_protocolVersion);
 
   // Send the login reply
@@ -673,8 +1038,12 @@ bool cVNSIClient::process_Login(cRequestPacket &req) /* OPCODE 1 */
   resp.add_S32(timeOffset);
   resp.add_String("VDR-Network-Streaming-Interface (VNSI) Server");
   resp.add_String(VNSI_SERVER_VERSION);
+  if (sentCapabilities)
+    resp.add_U32(capabilities);
   resp.finalise();
 
+  m_capabilities = capabilities;
+
   if (m_protocolVersion < VNSI_MIN_PROTOCOLVERSION)
     ERRORLOG("Client '%s' have a not allowed protocol version '%u', terminating client", clientName, m_protocolVersion);
   else
@@ -715,7 +1084,10 @@ bool cVNSIClient::process_EnableStatusInterface(cRequestPacket &req)
   bool enabled = req.extract_U8();
 
   SetStatusInterface(enabled);
+#ifndef __linux__
+  // not on a reactor worker, it serves other clients too
   SetPriority(1);
+#endif
 
   cResponsePacket resp;
   resp.init(req.getRequestID());
@@ -821,6 +1193,101 @@ bool cVNSIClient::process_InvalidateSocket(cRequestPacket &req) /* OPCODE 11 */
   return true;
 }
 
+bool cVNSIClient::process_SessionBootstrap(cRequestPacket &req) /* OPCODE 12 */
+{
+  uint32_t sections  = req.extract_U32();
+  bool filter        = req.extract_U8();
+  bool automatic     = req.extract_U8();
+  uint32_t since[4];
+  for (int i = 0; i < 4; i++)
+    since[i] = req.extract_U32();
+
+  std::vector<std::unique_ptr<cResponsePacket>> chunks;
+  chunks.emplace_back(new cResponsePacket);
+  chunks.back()->init(req.getRequestID());
+
+  {
+    // all sections are serialised from one snapshot: the timer lock first
+    // like the serialisers take it, then VDR's lists in VDR's lock order,
+    // the serialisers lock them again which nests in the same thread
+    cMutexLock timerLock(&m_timerLock);
+#if VDRVERSNUM >= 20301
+    LOCK_TIMERS_READ;
+    LOCK_CHANNELS_READ;
+    LOCK_RECORDINGS_READ;
+#else
+    Channels.Lock(false);
+    cThreadLock RecordingsLock(&Recordings);
+#endif
+
+    for (uint32_t section = VNSI_BOOTSTRAP_CHANNELS_TV; section <= VNSI_BOOTSTRAP_DELETED; section <<= 1)
+    {
+      if (!(sections & section))
+        continue;
+
+      // sections are not split, a chunk is closed once it is large enough
+      if (chunks.back()->getLen() >= CHUNK_SIZE)
+      {
+        chunks.back()->add_U32(0);
+        chunks.back()->add_U32(1);
+        chunks.back()->finalise();
+        chunks.emplace_back(new cResponsePacket);
+        chunks.back()->init(req.getRequestID());
+      }
+      cResponsePacket &resp = *chunks.back();
+
+      resp.add_U32(section);
+      uint32_t lengthPos = resp.getLen();
+      resp.add_U32(0);
+
+      switch (section)
+      {
+        case VNSI_BOOTSTRAP_CHANNELS_TV:
+        case VNSI_BOOTSTRAP_CHANNELS_RADIO:
+        {
+          bool radio = section == VNSI_BOOTSTRAP_CHANNELS_RADIO;
+          WriteChannelChanges(since[radio], radio, filter, resp);
+          break;
+        }
+
+        case VNSI_BOOTSTRAP_GROUPS:
+          m_channelgroups[0].clear();
+          m_channelgroups[1].clear();
+          CreateChannelGroups(automatic);
+          SerialiseGroups(resp, automatic, filter);
+          break;
+
+        case VNSI_BOOTSTRAP_TIMERS:
+          WriteTimerChanges(since[2], resp);
+          break;
+
+        case VNSI_BOOTSTRAP_RECORDINGS:
+          WriteRecordingChanges(since[3], resp);
+          break;
+
+        case VNSI_BOOTSTRAP_DELETED:
+          SerialiseDeletedRecordings(resp);
+          break;
+      }
+
+      uint32_t length = htonl(resp.getLen() - lengthPos - sizeof(uint32_t));
+      memcpy(resp.getPtr() + lengthPos, &length, sizeof(uint32_t));
+    }
+
+#if VDRVERSNUM < 20301
+    Channels.Unlock();
+#endif
+  }
+
+  // sent after releasing the locks, a slow client must not hold up VDR's writers
+  chunks.back()->add_U32(0);
+  chunks.back()->add_U32(0);
+  chunks.back()->finalise();
+  for (auto &chunk : chunks)
+    SendResponse(*chunk);
+  return true;
+}
+
 /** OPCODE 20 - 39: VNSI network functions for live streaming */
 
 bool cVNSIClient::processChannelStream_Open(cRequestPacket &req) /* OPCODE 20 */
@@ -855,8 +1322,14 @@ bool cVNSIClient::processChannelStream_Open(cRequestPacket &req) /* OPCODE 20 */
     ERRORLOG("Can't find channel %08x", uid);
     resp.add_U32(VNSI_RET_DATAINVALID);
   }
+  else if (!m_LiveSlot && !AcquireSlot(m_LiveStreams, VNSIServerConfig.max_live))
+  {
+    ERRORLOG("Too many live streams (%d), can't stream channel %s", VNSIServerConfig.max_live, channel->Name());
+    resp.add_U32(VNSI_RET_SERVERBUSY);
+  }
   else
   {
+    m_LiveSlot = true;
     if (StartChannelStreaming(resp, channel, priority, timeshift, timeout))
     {
       INFOLOG("Started streaming of channel %s (timeout %i seconds)", channel->Name(), timeout);
@@ -866,6 +1339,7 @@ bool cVNSIClient::processChannelStream_Open(cRequestPacket &req) /* OPCODE 20 */
     }
 
     DEBUGLOG("Can't stream channel %s", channel->Name());
+    StopChannelStreaming();
     resp.add_U32(VNSI_RET_DATALOCKED);
   }
 
@@ -939,6 +1413,51 @@ bool cVNSIClient::processChannelStream_StatusRequest(cRequestPacket &req) /* OPC
   return true;
 }
 
+bool cVNSIClient::processChannelStream_Shm(cRequestPacket &req) /* OPCODE 25 */
+{
+  uint32_t size = req.extract_U32();
+  if (size == 0)
+    size = SHM_RING_DEFAULT;
+  else if (size < SHM_RING_MIN)
+    size = SHM_RING_MIN;
+  else if (size > SHM_RING_MAX)
+    size = SHM_RING_MAX;
+
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+
+#ifdef __linux__
+  // the ring replaces the one of an earlier request, a running streamer
+  // keeps the one it was started with
+  std::shared_ptr<cShmRing> ring;
+  if ((m_capabilities & VNSI_CAP_SHMSTREAM) && m_socket.IsLocal())
+  {
+    ring = std::make_shared<cShmRing>();
+    if (!ring->Open(size))
+      ring.reset();
+  }
+
+  if (ring)
+  {
+    m_Ring = ring;
+    resp.add_U32(VNSI_RET_OK);
+    resp.add_U32(ring->GetSize());
+    resp.finalise();
+
+    int fds[3] = { ring->GetMemFd(), ring->GetDataFd(), ring->GetSpaceFd() };
+    m_socket.writefds(resp.getPtr(), resp.getLen(), fds, 3);
+    INFOLOG("Client %u: streaming through a shared ring of %zu bytes", m_Id, ring->GetSize());
+    return true;
+  }
+#endif
+
+  resp.add_U32(VNSI_RET_NOTSUPPORTED);
+  resp.add_U32(0);
+  resp.finalise();
+  m_socket.write(resp.getPtr(), resp.getLen());
+  return true;
+}
+
 /** OPCODE 40 - 59: VNSI network functions for recording streaming */
 
 bool cVNSIClient::processRecStream_Open(cRequestPacket &req) /* OPCODE 40 */
@@ -951,9 +1470,23 @@ bool cVNSIClient::processRecStream_Open(cRequestPacket &req) /* OPCODE 40 */
   cResponsePacket resp;
   resp.init(req.getRequestID());
 
-  if (recording && m_RecPlayer == NULL)
+  if (recording && m_RecPlayer == NULL &&
+      !AcquireSlot(m_RecordingStreams, VNSIServerConfig.max_recordings))
   {
+    ERRORLOG("Too many recording streams (%d)", VNSIServerConfig.max_recordings);
+    resp.add_U32(VNSI_RET_SERVERBUSY);
+  }
+  else if (recording && m_RecPlayer == NULL)
+  {
+    m_RecordingSlot = true;
     m_RecPlayer = new cRecPlayer(recording);
+    m_RecUID = uid;
+
+    // the average bitrate is what playback needs
+    uint32_t frames = m_RecPlayer->getLengthFrames();
+    double fps = m_RecPlayer->getFPS();
+    if (m_Pacer && frames && fps > 0)
+      m_Pacer->SetDemand(cPacer::RECORDING, m_RecPlayer->getLengthBytes() * fps / frames);
 
     resp.add_U32(VNSI_RET_OK);
     resp.add_U32(m_RecPlayer->getLengthFrames());
@@ -974,8 +1507,17 @@ bool cVNSIClient::processRecStream_Open(cRequestPacket &req) /* OPCODE 40 */
 
 bool cVNSIClient::processRecStream_Close(cRequestPacket &req) /* OPCODE 41 */
 {
+  delete m_RecPusher;
+  m_RecPusher = NULL;
   delete m_RecPlayer;
   m_RecPlayer = NULL;
+  if (m_Pacer)
+    m_Pacer->SetDemand(cPacer::RECORDING, 0);
+  if (m_RecordingSlot)
+  {
+    m_RecordingStreams--;
+    m_RecordingSlot = false;
+  }
 
   cResponsePacket resp;
   resp.init(req.getRequestID());
@@ -1005,19 +1547,42 @@ bool cVNSIClient::processRecStream_GetBlock(cRequestPacket &req) /* OPCODE 42 */
   cResponsePacket resp;
   resp.init(req.getRequestID());
 
-  uint8_t* p = resp.reserve(amount);
-  uint32_t amountReceived = m_RecPlayer->getBlock(p, position, amount);
+  // runs on a shared worker, the block is made smaller instead of waiting
+  if (m_Pacer)
+    amount = m_Pacer->Limit(amount);
 
-  if(amount > amountReceived) resp.unreserve(amount - amountReceived);
+  int fd;
+  uint64_t filePosition;
+  int amountReceived = m_RecPlayer->getBlockFile(position, amount, fd, filePosition);
 
-  if (!amountReceived)
+  if (amountReceived <= 0)
   {
     resp.add_U32(0);
     DEBUGLOG("written 4(0) as getblock got 0");
+    resp.finalise();
+    m_socket.write(resp.getPtr(), resp.getLen());
+    return true;
   }
 
+  // only the header goes through the packet, the block is sent from the
+  // recording file
+  uint32_t headerLength = resp.getLen();
+  resp.setLen(headerLength + amountReceived);
   resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+  ssize_t sent = m_socket.sendfile(resp.getPtr(), headerLength, fd, filePosition, amountReceived);
+
+  // the block was never in the buffer, don't let it count for the size
+  // hint of the next response
+  resp.setLen(headerLength);
+
+  if (sent != amountReceived)
+  {
+    ERRORLOG("Get block: failed to send %d bytes", amountReceived);
+    m_socket.Shutdown();
+    return true;
+  }
+
+  m_RecPlayer->releaseBlock(filePosition, amountReceived);
   return true;
 }
 
@@ -1119,6 +1684,84 @@ bool cVNSIClient::processRecStream_GetLength(cRequestPacket &req) /* OPCODE 46 *
   return true;
 }
 
+bool cVNSIClient::processRecStream_Push(cRequestPacket &req) /* OPCODE 47 */
+{
+  uint64_t position = req.extract_U64();
+  uint32_t credit   = req.extract_U32();
+
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+
+  const cRecording *recording = NULL;
+  if (m_RecPlayer && !m_RecPusher && (m_capabilities & VNSI_CAP_RECPUSH))
+    recording = cRecordingsCache::GetInstance().Lookup(m_RecUID);
+
+  if (recording)
+  {
+    // the reply with the serial goes out before the first block with it,
+    // the pusher waits for the write lock
+    m_RecPusher = new cRecPusher(m_socket, recording, m_Pacer.get());
+    m_socket.LockWrite();
+    uint32_t serial = m_RecPusher->Start(position, credit);
+
+    resp.add_U32(VNSI_RET_OK);
+    resp.add_U32(serial);
+    resp.finalise();
+    m_socket.write(resp.getPtr(), resp.getLen());
+    m_socket.UnlockWrite();
+  }
+  else
+  {
+    resp.add_U32(VNSI_RET_DATAUNKNOWN);
+    ERRORLOG("%s - unable to push recording", __FUNCTION__);
+    resp.finalise();
+    m_socket.write(resp.getPtr(), resp.getLen());
+  }
+
+  return true;
+}
+
+bool cVNSIClient::processRecStream_Credit(cRequestPacket &req) /* OPCODE 48 */
+{
+  // granted all the time while playing, not answered
+  uint32_t credit = req.extract_U32();
+
+  if (m_RecPusher)
+    m_RecPusher->AddCredit(credit);
+
+  return true;
+}
+
+bool cVNSIClient::processRecStream_Seek(cRequestPacket &req) /* OPCODE 49 */
+{
+  uint64_t position = req.extract_U64();
+  uint32_t credit   = req.extract_U32();
+
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+
+  if (m_RecPusher)
+  {
+    // as on start, the reply goes out before the blocks of the new serial
+    m_socket.LockWrite();
+    uint32_t serial = m_RecPusher->Seek(position, credit);
+
+    resp.add_U32(VNSI_RET_OK);
+    resp.add_U32(serial);
+    resp.finalise();
+    m_socket.write(resp.getPtr(), resp.getLen());
+    m_socket.UnlockWrite();
+  }
+  else
+  {
+    resp.add_U32(VNSI_RET_ERROR);
+    resp.finalise();
+    m_socket.write(resp.getPtr(), resp.getLen());
+  }
+
+  return true;
+}
+
 /** OPCODE 60 - 79: VNSI network functions for channel access */
 
 bool cVNSIClient::processCHANNELS_ChannelsCount(cRequestPacket &req) /* OPCODE 61 */
@@ -1151,72 +1794,64 @@ bool cVNSIClient::processCHANNELS_GetChannels(cRequestPacket &req) /* OPCODE 63
   bool radio = req.extract_U32();
   bool filter = req.extract_U8();
 
-#if VDRVERSNUM >= 20301
-  cStateKey ChannelsKey(true);
-  const cChannels *Channels = cChannels::GetChannelsRead(ChannelsKey);
-#else
-  Channels.Lock(false);
-#endif
-
   cResponsePacket resp;
   resp.init(req.getRequestID());
+  SerialiseChannels(resp, radio, filter);
+  resp.finalise();
+  SendResponse(resp);
 
-  cString caids;
-  int caid;
-  int caid_idx;
-#if VDRVERSNUM >= 20301
-  for (const cChannel *channel = Channels->First(); channel; channel = Channels->Next(channel))
-#else
-  for (cChannel *channel = Channels.First(); channel; channel = Channels.Next(channel))
-#endif
-  {
-    if (radio != cVNSIChannelFilter::IsRadio(channel))
-      continue;
+  return true;
+}
 
-    // skip invalid channels
-    if (channel->Sid() == 0)
-      continue;
+bool cVNSIClient::processCHANNELS_GetChanges(cRequestPacket &req) /* OPCODE 73 */
+{
+  uint32_t since = req.extract_U32();
+  bool radio = req.extract_U32();
+  bool filter = req.extract_U8();
 
-    if (endswith(channel->Name(), "OBSOLETE"))
-      continue;
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+  resp.add_U32(VNSI_RET_OK);
+  WriteChannelChanges(since, radio, filter, resp);
+  resp.finalise();
+  SendResponse(resp);
 
-    // check filter
-    if (filter && !VNSIChannelFilter.PassFilter(*channel))
-      continue;
+  return true;
+}
 
-    uint32_t uuid = CreateChannelUID(channel);
-    resp.add_U32(channel->Number());
-    resp.add_String(m_toUTF8.Convert(channel->Name()));
-    resp.add_String(m_toUTF8.Convert(channel->Provider()));
-    resp.add_U32(uuid);
-    resp.add_U32(channel->Ca(0));
-    caid_idx = 0;
-    caids = "caids:";
-    while((caid = channel->Ca(caid_idx)) != 0)
-    {
-      caids = cString::sprintf("%s%d;", (const char*)caids, caid);
-      caid_idx++;
-    }
-    resp.add_String((const char*)caids);
-    if (m_protocolVersion >= 6)
-    {
-      resp.add_String(CreatePiconRef(channel));
-    }
+void cVNSIClient::SerialiseChannels(cResponsePacket &resp, bool radio, bool filter)
+{
+  std::shared_ptr<const cChannelListCache::sList> list =
+    cChannelListCache::GetInstance().Get(radio, filter, m_protocolVersion >= 6);
 
-    // create entry in EPG map on first query
-    m_epgUpdate.insert(std::make_pair(uuid, sEpgUpdate()));
-  }
+  resp.copyin(list->data.data(), list->data.size());
 
-#if VDRVERSNUM >= 20301
-  ChannelsKey.Remove();
-#else
-  Channels.Unlock();
-#endif
+  // create entries in EPG map on first query
+  cMutexLock epgLock(&m_epgLock);
+  for (const auto &item : list->items)
+    m_epgUpdate.insert(std::make_pair(item.uid, sEpgUpdate()));
+}
 
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+void cVNSIClient::WriteChannelChanges(uint32_t since, bool radio, bool filter, cResponsePacket &resp)
+{
+  bool piconRef = m_protocolVersion >= 6;
+  std::shared_ptr<const cChannelListCache::sList> list =
+    cChannelListCache::GetInstance().Get(radio, filter, piconRef);
 
-  return true;
+  {
+    cMutexLock epgLock(&m_epgLock);
+    for (const auto &item : list->items)
+      m_epgUpdate.insert(std::make_pair(item.uid, sEpgUpdate()));
+  }
+
+  // the cached list is built anew on any change, its serial tells the
+  // journal whether to diff it
+  cChangeJournal &journal = cChangeJournal::Get(radio ? cChangeJournal::CHANNELS_RADIO : cChangeJournal::CHANNELS_TV,
+                                                filter | piconRef << 1);
+  journal.WriteChanges(since, list->serial, [&list](cChangeJournal::sList &changes)
+  {
+    changes = *list;
+  }, resp);
 }
 
 bool cVNSIClient::processCHANNELS_GroupsCount(cRequestPacket &req)
@@ -1263,7 +1898,7 @@ bool cVNSIClient::processCHANNELS_GroupList(cRequestPacket &req)
   }
 
   resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+  SendResponse(resp);
   return true;
 }
 
@@ -1272,19 +1907,22 @@ bool cVNSIClient::processCHANNELS_GetGroupMembers(cRequestPacket &req)
   char* groupname = req.extract_String();
   uint32_t radio = req.extract_U8();
   bool filter = req.extract_U8();
-  int index = 0;
 
   cResponsePacket resp;
   resp.init(req.getRequestID());
 
   // unknown group
-  if(m_channelgroups[radio].find(groupname) == m_channelgroups[radio].end())
-  {
-    resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
-    return true;
-  }
+  if(m_channelgroups[radio].find(groupname) != m_channelgroups[radio].end())
+    SerialiseGroupMembers(resp, groupname, radio, filter);
+
+  resp.finalise();
+  SendResponse(resp);
+  return true;
+}
 
+uint32_t cVNSIClient::SerialiseGroupMembers(cResponsePacket &resp, const char *groupname, bool radio, bool filter)
+{
+  int index = 0;
   bool automatic = m_channelgroups[radio][groupname].automatic;
   std::string name;
 
@@ -1335,9 +1973,78 @@ bool cVNSIClient::processCHANNELS_GetGroupMembers(cRequestPacket &req)
   Channels.Unlock();
 #endif
 
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
-  return true;
+  return index;
+}
+
+void cVNSIClient::SerialiseGroups(cResponsePacket &resp, bool automatic, bool filter)
+{
+  // the members of all groups are collected in one pass over the channels
+  std::map<std::string, std::vector<uint32_t>> members[2];
+  std::string name;
+
+#if VDRVERSNUM >= 20301
+  cStateKey ChannelsKey(true);
+  const cChannels *Channels = cChannels::GetChannelsRead(ChannelsKey);
+  for (const cChannel *channel = Channels->First(); channel; channel = Channels->Next(channel))
+#else
+  Channels.Lock(false);
+  for (cChannel *channel = Channels.First(); channel; channel = Channels.Next(channel))
+#endif
+  {
+    if(automatic && !channel->GroupSep())
+      name = channel->Provider();
+    else
+    {
+      if(channel->GroupSep())
+      {
+        name = channel->Name();
+        continue;
+      }
+    }
+
+    if(name.empty())
+      continue;
+
+    if (endswith(channel->Name(), "OBSOLETE"))
+      continue;
+
+    // check filter
+    if (filter && !VNSIChannelFilter.PassFilter(*channel))
+      continue;
+
+    members[cVNSIChannelFilter::IsRadio(channel)][name].push_back(CreateChannelUID(channel));
+  }
+
+#if VDRVERSNUM >= 20301
+  ChannelsKey.Remove();
+#else
+  Channels.Unlock();
+#endif
+
+  for (int radio = 0; radio <= 1; radio++)
+  {
+    resp.add_U32(m_channelgroups[radio].size());
+    for (const auto &i : m_channelgroups[radio])
+    {
+      resp.add_String(i.second.name.c_str());
+      resp.add_U8(i.second.radio);
+
+      auto group = members[radio].find(i.first);
+      if (group == members[radio].end())
+      {
+        resp.add_U32(0);
+        continue;
+      }
+
+      resp.add_U32(group->second.size());
+      uint32_t index = 0;
+      for (uint32_t uid : group->second)
+      {
+        resp.add_U32(uid);
+        resp.add_U32(++index);
+      }
+    }
+  }
 }
 
 bool cVNSIClient::processCHANNELS_GetCaids(cRequestPacket &req)
@@ -1621,7 +2328,7 @@ bool cVNSIClient::processTIMER_Get(cRequestPacket &req) /* OPCODE 81 */
         resp.add_U32(timer->StopTime());
         resp.add_U32(timer->Day());
         resp.add_U32(timer->WeekDays());
-        resp.add_String(m_toUTF8.Convert(timer->File()));
+        resp.add_String(ToUTF8().Convert(timer->File()));
         if (m_protocolVersion >= 9)
         {
           resp.add_String("");
@@ -1647,7 +2354,64 @@ bool cVNSIClient::processTIMER_GetList(cRequestPacket &req) /* OPCODE 82 */
 {
   cResponsePacket resp;
   resp.init(req.getRequestID());
+  SerialiseTimers(resp, nullptr);
+  resp.finalise();
+  SendResponse(resp);
+  return true;
+}
+
+bool cVNSIClient::processTIMER_GetChanges(cRequestPacket &req) /* OPCODE 87 */
+{
+  uint32_t since = req.extract_U32();
+
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+  resp.add_U32(VNSI_RET_OK);
+  WriteTimerChanges(since, resp);
+  resp.finalise();
+  SendResponse(resp);
+  return true;
+}
+
+uint64_t cVNSIClient::ListSource(cChangeJournal::eKind kind)
+{
+#if VDRVERSNUM >= 20301
+  cMutexLock lock(&listStateMutex);
+
+  // timers and recordings show channel names, recordings show timers of
+  // running recordings
+  uint64_t source = ListChanged(channelsState, cChannels::GetChannelsRead(channelsState.key) != nullptr);
+  source = std::max(source, ListChanged(timersState, cTimers::GetTimersRead(timersState.key) != nullptr));
+  if (kind == cChangeJournal::TIMERS)
+  {
+    if (m_vnsiTimers.StateChange(vnsiTimersState) || !vnsiTimersSerial)
+      vnsiTimersSerial = ++listStateSerial;
+    source = std::max(source, vnsiTimersSerial);
+  }
+  else if (kind == cChangeJournal::RECORDINGS)
+    source = std::max(source, ListChanged(recordingsState, cRecordings::GetRecordingsRead(recordingsState.key) != nullptr));
+  return source;
+#else
+  // no state to tell a change, built on each request
+  return 0;
+#endif
+}
+
+void cVNSIClient::WriteTimerChanges(uint32_t since, cResponsePacket &resp)
+{
+  uint32_t format = m_protocolVersion >= 10 ? 2 : m_protocolVersion >= 9 ? 1 : 0;
+  cChangeJournal &journal = cChangeJournal::Get(cChangeJournal::TIMERS, format);
+  journal.WriteChanges(since, ListSource(cChangeJournal::TIMERS), [this](cChangeJournal::sList &changes)
+  {
+    cResponsePacket list;
+    list.init(0);
+    SerialiseTimers(list, &changes.items);
+    changes.data.assign(list.getPtr(), list.getPtr() + list.getLen());
+  }, resp);
+}
 
+void cVNSIClient::SerialiseTimers(cResponsePacket &resp, std::vector<cChangeJournal::sItem> *items)
+{
   cMutexLock lock(&m_timerLock);
 
 #if VDRVERSNUM >= 20301
@@ -1668,6 +2432,7 @@ bool cVNSIClient::processTIMER_GetList(cRequestPacket &req) /* OPCODE 82 */
     if (!timer)
       continue;
 
+    uint32_t start = resp.getLen();
     if (m_protocolVersion >= 9)
     {
       uint32_t type;
@@ -1693,7 +2458,7 @@ bool cVNSIClient::processTIMER_GetList(cRequestPacket &req) /* OPCODE 82 */
     resp.add_U32(timer->StopTime());
     resp.add_U32(timer->Day());
     resp.add_U32(timer->WeekDays());
-    resp.add_String(m_toUTF8.Convert(timer->File()));
+    resp.add_String(ToUTF8().Convert(timer->File()));
     if (m_protocolVersion >= 9)
     {
       resp.add_String("");
@@ -1702,11 +2467,20 @@ bool cVNSIClient::processTIMER_GetList(cRequestPacket &req) /* OPCODE 82 */
     {
       resp.add_U32(m_vnsiTimers.GetParent(timer));
     }
+    if (items)
+    {
+#if VDRVERSNUM >= 20301
+      items->push_back(cChangeJournal::sItem{(uint32_t)timer->Id(), start, resp.getLen() - start});
+#else
+      items->push_back(cChangeJournal::sItem{(uint32_t)timer->Index()+1, start, resp.getLen() - start});
+#endif
+    }
   }
 
   std::vector<CVNSITimer> vnsitimers = m_vnsiTimers.GetTimers();
   for (auto &vnsitimer : vnsitimers)
   {
+    uint32_t start = resp.getLen();
     resp.add_U32(VNSI_TIMER_TYPE_EPG_SEARCH);
     resp.add_U32(vnsitimer.m_id | m_vnsiTimers.VNSITIMER_MASK);
     resp.add_U32(vnsitimer.m_enabled);
@@ -1726,10 +2500,9 @@ bool cVNSIClient::processTIMER_GetList(cRequestPacket &req) /* OPCODE 82 */
     {
       resp.add_U32(0);
     }
+    if (items)
+      items->push_back(cChangeJournal::sItem{vnsitimer.m_id | m_vnsiTimers.VNSITIMER_MASK, start, resp.getLen() - start});
   }
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
-  return true;
 }
 
 bool cVNSIClient::processTIMER_Add(cRequestPacket &req) /* OPCODE 83 */
@@ -2138,6 +2911,41 @@ bool cVNSIClient::processRECORDINGS_GetCount(cRequestPacket &req) /* OPCODE 101
 }
 
 bool cVNSIClient::processRECORDINGS_GetList(cRequestPacket &req) /* OPCODE 102 */
+{
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+  SerialiseRecordings(resp, nullptr);
+  resp.finalise();
+  SendResponse(resp);
+  return true;
+}
+
+bool cVNSIClient::processRECORDINGS_GetChanges(cRequestPacket &req) /* OPCODE 106 */
+{
+  uint32_t since = req.extract_U32();
+
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+  resp.add_U32(VNSI_RET_OK);
+  WriteRecordingChanges(since, resp);
+  resp.finalise();
+  SendResponse(resp);
+  return true;
+}
+
+void cVNSIClient::WriteRecordingChanges(uint32_t since, cResponsePacket &resp)
+{
+  cChangeJournal &journal = cChangeJournal::Get(cChangeJournal::RECORDINGS, m_protocolVersion >= 9);
+  journal.WriteChanges(since, ListSource(cChangeJournal::RECORDINGS), [this](cChangeJournal::sList &changes)
+  {
+    cResponsePacket list;
+    list.init(0);
+    SerialiseRecordings(list, &changes.items);
+    changes.data.assign(list.getPtr(), list.getPtr() + list.getLen());
+  }, resp);
+}
+
+void cVNSIClient::SerialiseRecordings(cResponsePacket &resp, std::vector<cChangeJournal::sItem> *items)
 {
   cMutexLock lock(&m_timerLock);
 #if VDRVERSNUM >= 20301
@@ -2147,15 +2955,13 @@ bool cVNSIClient::processRECORDINGS_GetList(cRequestPacket &req) /* OPCODE 102 *
   cThreadLock RecordingsLock(&Recordings);
 #endif
 
-  cResponsePacket resp;
-  resp.init(req.getRequestID());
-
 #if VDRVERSNUM >= 20301
   for (const cRecording *recording = Recordings->First(); recording; recording = Recordings->Next(recording))
 #else
   for (cRecording *recording = Recordings.First(); recording; recording = Recordings.Next(recording))
 #endif
   {
+    uint32_t start = resp.getLen();
     const cEvent *event = recording->Info()->GetEvent();
 
     time_t recordingStart    = 0;
@@ -2193,7 +2999,7 @@ bool cVNSIClient::processRECORDINGS_GetList(cRequestPacket &req) /* OPCODE 102 *
     resp.add_U32(recording->Lifetime());
 
     // channel_name
-    resp.add_String(recording->Info()->ChannelName() ? m_toUTF8.Convert(recording->Info()->ChannelName()) : "");
+    resp.add_String(recording->Info()->ChannelName() ? ToUTF8().Convert(recording->Info()->ChannelName()) : "");
     if (m_protocolVersion >= 9)
     {
       // channel uuid
@@ -2232,17 +3038,17 @@ bool cVNSIClient::processRECORDINGS_GetList(cRequestPacket &req) /* OPCODE 102 *
     }
 
     // title
-    resp.add_String(m_toUTF8.Convert(recname));
+    resp.add_String(ToUTF8().Convert(recname));
 
     // subtitle
     if (!isempty(recording->Info()->ShortText()))
-      resp.add_String(m_toUTF8.Convert(recording->Info()->ShortText()));
+      resp.add_String(ToUTF8().Convert(recording->Info()->ShortText()));
     else
       resp.add_String("");
 
     // description
     if (!isempty(recording->Info()->Description()))
-      resp.add_String(m_toUTF8.Convert(recording->Info()->Description()));
+      resp.add_String(ToUTF8().Convert(recording->Info()->Description()));
     else
       resp.add_String("");
 
@@ -2295,18 +3101,16 @@ bool cVNSIClient::processRECORDINGS_GetList(cRequestPacket &req) /* OPCODE 102 *
       free(filename);
     }
 
-    resp.add_String(strDirectory.empty() ? "" : m_toUTF8.Convert(strDirectory.c_str()));
+    resp.add_String(strDirectory.empty() ? "" : ToUTF8().Convert(strDirectory.c_str()));
 
     // filename / uid of recording
     uint32_t uid = cRecordingsCache::GetInstance().Register(recording, false);
     resp.add_U32(uid);
+    if (items)
+      items->push_back(cChangeJournal::sItem{uid, start, resp.getLen() - start});
 
     free(fullname);
   }
-
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
-  return true;
 }
 
 bool cVNSIClient::processRECORDINGS_Rename(cRequestPacket &req) /* OPCODE 103 */
@@ -2469,7 +3273,7 @@ bool cVNSIClient::processRECORDINGS_GetEdl(cRequestPacket &req) /* OPCODE 105 */
     }
   }
   resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+  SendResponse(resp);
 
   return true;
 }
@@ -2477,6 +3281,62 @@ bool cVNSIClient::processRECORDINGS_GetEdl(cRequestPacket &req) /* OPCODE 105 */
 
 /** OPCODE 120 - 139: VNSI network functions for epg access and manipulating */
 
+static bool EventInWindow(const cEvent *event, uint32_t now, uint32_t startTime, uint32_t duration)
+{
+  uint32_t eventTime     = event->StartTime();
+  uint32_t eventDuration = event->Duration();
+
+  //in the past filter
+  if ((eventTime + eventDuration) < now)
+    return false;
+
+  //start time filter
+  if ((eventTime + eventDuration) <= startTime)
+    return false;
+
+  //duration filter
+  if (duration != 0 && eventTime >= (startTime + duration))
+    return false;
+
+  return true;
+}
+
+static void SerialiseEvent(cResponsePacket &resp, const cEvent *event)
+{
+  uint32_t thisEventContent;
+  uint32_t thisEventRating;
+  const char* thisEventTitle        = event->Title();
+  const char* thisEventSubTitle     = event->ShortText();
+  const char* thisEventDescription  = event->Description();
+#if defined(USE_PARENTALRATING) || defined(PARENTALRATINGCONTENTVERSNUM)
+  thisEventContent      = event->Contents();
+  thisEventRating       = 0;
+#elif APIVERSNUM >= 10711
+  thisEventContent      = event->Contents();
+  thisEventRating       = event->ParentalRating();
+#else
+  thisEventContent      = 0;
+  thisEventRating       = 0;
+#endif
+
+  if (!thisEventTitle)
+    thisEventTitle = "";
+  if (!thisEventSubTitle)
+    thisEventSubTitle = "";
+  if (!thisEventDescription)
+    thisEventDescription = "";
+
+  resp.add_U32(event->EventID());
+  resp.add_U32(event->StartTime());
+  resp.add_U32(event->Duration());
+  resp.add_U32(thisEventContent);
+  resp.add_U32(thisEventRating);
+
+  resp.add_String(ToUTF8().Convert(thisEventTitle));
+  resp.add_String(ToUTF8().Convert(thisEventSubTitle));
+  resp.add_String(ToUTF8().Convert(thisEventDescription));
+}
+
 bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
 {
   uint32_t channelUID  = 0;
@@ -2508,7 +3368,7 @@ bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
   {
     resp.add_U32(0);
     resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
+    SendResponse(resp);
 #if VDRVERSNUM < 20301
     Channels.Unlock();
 #endif
@@ -2524,7 +3384,7 @@ bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
   {
     resp.add_U32(0);
     resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
+    SendResponse(resp);
     Channels.Unlock();
 
     DEBUGLOG("written 0 because Schedule!s! = NULL");
@@ -2541,7 +3401,7 @@ bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
   {
     resp.add_U32(0);
     resp.finalise();
-    m_socket.write(resp.getPtr(), resp.getLen());
+    SendResponse(resp);
 #if VDRVERSNUM < 20301
     Channels.Unlock();
 #endif
@@ -2551,64 +3411,14 @@ bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
   }
 
   bool atLeastOneEvent = false;
-
-  uint32_t thisEventID;
-  uint32_t thisEventTime;
-  uint32_t thisEventDuration;
-  uint32_t thisEventContent;
-  uint32_t thisEventRating;
-  const char* thisEventTitle;
-  const char* thisEventSubTitle;
-  const char* thisEventDescription;
+  uint32_t now = time(NULL);
 
   for (const cEvent* event = Schedule->Events()->First(); event; event = Schedule->Events()->Next(event))
   {
-    thisEventID           = event->EventID();
-    thisEventTitle        = event->Title();
-    thisEventSubTitle     = event->ShortText();
-    thisEventDescription  = event->Description();
-    thisEventTime         = event->StartTime();
-    thisEventDuration     = event->Duration();
-#if defined(USE_PARENTALRATING) || defined(PARENTALRATINGCONTENTVERSNUM)
-    thisEventContent      = event->Contents();
-    thisEventRating       = 0;
-#elif APIVERSNUM >= 10711
-    thisEventContent      = event->Contents();
-    thisEventRating       = event->ParentalRating();
-#else
-    thisEventContent      = 0;
-    thisEventRating       = 0;
-#endif
-
-    //in the past filter
-    if ((thisEventTime + thisEventDuration) < (uint32_t)time(NULL))
-      continue;
-
-    //start time filter
-    if ((thisEventTime + thisEventDuration) <= startTime)
+    if (!EventInWindow(event, now, startTime, duration))
       continue;
 
-    //duration filter
-    if (duration != 0 && thisEventTime >= (startTime + duration))
-      continue;
-
-    if (!thisEventTitle)
-      thisEventTitle = "";
-    if (!thisEventSubTitle)
-      thisEventSubTitle = "";
-    if (!thisEventDescription)
-      thisEventDescription = "";
-
-    resp.add_U32(thisEventID);
-    resp.add_U32(thisEventTime);
-    resp.add_U32(thisEventDuration);
-    resp.add_U32(thisEventContent);
-    resp.add_U32(thisEventRating);
-
-    resp.add_String(m_toUTF8.Convert(thisEventTitle));
-    resp.add_String(m_toUTF8.Convert(thisEventSubTitle));
-    resp.add_String(m_toUTF8.Convert(thisEventDescription));
-
+    SerialiseEvent(resp, event);
     atLeastOneEvent = true;
   }
 
@@ -2625,11 +3435,12 @@ bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
   }
 
   resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
+  SendResponse(resp);
 
   const cEvent *lastEvent =  Schedule->Events()->Last();
   if (lastEvent)
   {
+    cMutexLock epgLock(&m_epgLock);
     auto &u = m_epgUpdate[channelUID];
     u.lastEvent = lastEvent->StartTime();
     u.attempts = 0;
@@ -2640,6 +3451,98 @@ bool cVNSIClient::processEPG_GetForChannel(cRequestPacket &req) /* OPCODE 120 */
 }
 
 
+bool cVNSIClient::processEPG_GetBulk(cRequestPacket &req) /* OPCODE 121 */
+{
+  uint32_t startTime = req.extract_U32();
+  uint32_t duration  = req.extract_U32();
+  uint32_t count     = req.extract_U32();
+
+  std::vector<uint32_t> channelUIDs;
+  for (uint32_t i = 0; i < count; i++)
+    channelUIDs.push_back(req.extract_U32());
+
+  // none given, all channels passing the filter like the channel lists
+  if (count == 0)
+  {
+    bool piconRef = m_protocolVersion >= 6;
+    for (int radio = 0; radio < 2; radio++)
+    {
+      std::shared_ptr<const cChannelListCache::sList> list =
+        cChannelListCache::GetInstance().Get(radio, true, piconRef);
+      for (const auto &item : list->items)
+        channelUIDs.push_back(item.uid);
+    }
+  }
+
+  uint32_t now = time(NULL);
+  size_t next = 0;
+
+  // each chunk is built under the locks and sent after releasing them,
+  // a slow client must not hold up VDR's writers
+  do
+  {
+    cResponsePacket resp;
+    resp.init(req.getRequestID());
+
+    {
+#if VDRVERSNUM >= 20301
+      LOCK_CHANNELS_READ;
+      LOCK_SCHEDULES_READ;
+#else
+      Channels.Lock(false);
+      cSchedulesLock MutexLock;
+      const cSchedules *Schedules = cSchedules::Schedules(MutexLock);
+#endif
+
+      while (next < channelUIDs.size() && resp.getLen() < CHUNK_SIZE)
+      {
+        uint32_t channelUID = channelUIDs[next++];
+        const cChannel *channel = FindChannelByUID(channelUID);
+        const cSchedule *Schedule = NULL;
+        if (Schedules && channel)
+          Schedule = Schedules->GetSchedule(channel->GetChannelID());
+        if (!Schedule)
+          continue;
+
+        uint32_t events = 0;
+        for (const cEvent* event = Schedule->Events()->First(); event; event = Schedule->Events()->Next(event))
+        {
+          if (EventInWindow(event, now, startTime, duration))
+            events++;
+        }
+
+        resp.add_U32(channelUID);
+        resp.add_U32(events);
+        for (const cEvent* event = Schedule->Events()->First(); event; event = Schedule->Events()->Next(event))
+        {
+          if (EventInWindow(event, now, startTime, duration))
+            SerialiseEvent(resp, event);
+        }
+
+        const cEvent *lastEvent = Schedule->Events()->Last();
+        if (lastEvent)
+        {
+          cMutexLock epgLock(&m_epgLock);
+          auto &u = m_epgUpdate[channelUID];
+          u.lastEvent = lastEvent->StartTime();
+          u.attempts = 0;
+        }
+      }
+
+#if VDRVERSNUM < 20301
+      Channels.Unlock();
+#endif
+    }
+
+    resp.add_U32(0);
+    resp.add_U32(next < channelUIDs.size());
+    resp.finalise();
+    SendResponse(resp);
+  } while (next < channelUIDs.size());
+
+  return true;
+}
+
 /*!
  * OPCODE 140 - 169:
  * VNSI network functions for channel scanning
@@ -2923,7 +3826,14 @@ bool cVNSIClient::processRECORDINGS_DELETED_GetList(cRequestPacket &req) /* OPCO
 {
   cResponsePacket resp;
   resp.init(req.getRequestID());
+  SerialiseDeletedRecordings(resp);
+  resp.finalise();
+  SendResponse(resp);
+  return true;
+}
 
+void cVNSIClient::SerialiseDeletedRecordings(cResponsePacket &resp)
+{
   cMutexLock lock(&m_timerLock);
 
 #if VDRVERSNUM >= 20301
@@ -2975,7 +3885,7 @@ bool cVNSIClient::processRECORDINGS_DELETED_GetList(cRequestPacket &req) /* OPCO
     resp.add_U32(recording->Lifetime());
 
     // channel_name
-    resp.add_String(recording->Info()->ChannelName() ? m_toUTF8.Convert(recording->Info()->ChannelName()) : "");
+    resp.add_String(recording->Info()->ChannelName() ? ToUTF8().Convert(recording->Info()->ChannelName()) : "");
 
     char* fullname = strdup(recording->Name());
     char* recname = strrchr(fullname, FOLDERDELIMCHAR);
@@ -2991,17 +3901,17 @@ bool cVNSIClient::processRECORDINGS_DELETED_GetList(cRequestPacket &req) /* OPCO
     }
 
     // title
-    resp.add_String(m_toUTF8.Convert(recname));
+    resp.add_String(ToUTF8().Convert(recname));
 
     // subtitle
     if (!isempty(recording->Info()->ShortText()))
-      resp.add_String(m_toUTF8.Convert(recording->Info()->ShortText()));
+      resp.add_String(ToUTF8().Convert(recording->Info()->ShortText()));
     else
       resp.add_String("");
 
     // description
     if (!isempty(recording->Info()->Description()))
-      resp.add_String(m_toUTF8.Convert(recording->Info()->Description()));
+      resp.add_String(ToUTF8().Convert(recording->Info()->Description()));
     else
       resp.add_String("");
 
@@ -3016,7 +3926,7 @@ bool cVNSIClient::processRECORDINGS_DELETED_GetList(cRequestPacket &req) /* OPCO
       while(*directory == '/') directory++;
     }
 
-    resp.add_String((isempty(directory)) ? "" : m_toUTF8.Convert(directory));
+    resp.add_String((isempty(directory)) ? "" : ToUTF8().Convert(directory));
 
     // filename / uid of recording
     uint32_t uid = cRecordingsCache::GetInstance().Register(recording, false);
@@ -3024,10 +3934,6 @@ bool cVNSIClient::processRECORDINGS_DELETED_GetList(cRequestPacket &req) /* OPCO
 
     free(fullname);
   }
-
-  resp.finalise();
-  m_socket.write(resp.getPtr(), resp.getLen());
-  return true;
 }
 
 bool cVNSIClient::processRECORDINGS_DELETED_Delete(cRequestPacket &req) /* OPCODE 183 */
@@ -3266,39 +4172,3 @@ bool cVNSIClient::processRECORDINGS_DELETED_DeleteAll(cRequestPacket &req) /* OP
 
   return true;
 }
-
-// part of this method is taken from XVDR
-cString cVNSIClient::CreatePiconRef(const cChannel* channel)
-{
-  int hash = 0;
-
-  if(cSource::IsSat(channel->Source()))
-  {
-    int16_t pos = channel->Source() & cSource::st_Pos;
-    hash = pos;
-
-#if VDRVERSNUM >= 20101
-    if(hash < 0)
-    {
-      hash = 3600 + hash;
-    }
-#endif
-
-    hash = hash << 16;
-  }
-  else if(cSource::IsCable(channel->Source()))
-    hash = 0xFFFF0000;
-  else if(cSource::IsTerr(channel->Source()))
-    hash = 0xEEEE0000;
-  else if(cSource::IsAtsc(channel->Source()))
-    hash = 0xDDDD0000;
-
-  cString serviceref = cString::sprintf("1_0_%i_%X_%X_%X_%X_0_0_0",
-                                cVNSIChannelFilter::IsRadio(channel) ? 2 : (channel->Vtype() == 27) ? 19 : 1,
-                                channel->Sid(),
-                                channel->Tid(),
-                                channel->Nid(),
-                                hash);
-
-  return serviceref;
-}
@@ -33,10 +33,14 @@
 #include "config.h"
 #include "cxsocket.h"
 #include "channelscancontrol.h"
+#include "changejournal.h"
 
 #include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #define VNSI_EPG_AGAIN 1
 #define VNSI_EPG_PAUSE 2
@@ -47,8 +51,12 @@ class cLiveStreamer;
 class cRequestPacket;
 class cResponsePacket;
 class cRecPlayer;
+class cRecPusher;
+class cShmRing;
+class cPacer;
 class cCmdControl;
 class cVnsiOsdProvider;
+struct sStreamStats;
 class CVNSITimers;
 
 class cVNSIClient : public cThread
@@ -68,6 +76,35 @@ public:
   void SignalTimerChange();
   int EpgChange();
   unsigned int GetID() { return m_Id; }
+  cString GetStats();
+  bool IsActive() { return m_Connected; }
+
+  /*!
+   * Process one request read from the control connection. Takes the
+   * ownership of data. Returns false if the connection is to be closed.
+   */
+  bool HandleRequest(uint32_t requestID, uint32_t opcode, uint8_t *data, uint32_t dataLength);
+
+  /*!
+   * True if the request may be processed next to others of this client
+   * (VNSI_CAP_OUTOFORDER), without waiting for the ones before it.
+   */
+  bool IsConcurrent(uint32_t opcode) const;
+
+  /*!
+   * The control connection is gone, stop streaming and let the status
+   * thread remove the client.
+   */
+  void Disconnected();
+
+  /*!
+   * Status messages are queued by the status thread and VDR's callbacks
+   * and sent by the client's I/O context, which the wakeup asks to call
+   * FlushStatus. Without a wakeup they are sent right away.
+   */
+  void SetStatusWakeup(std::function<void()> wakeup);
+  bool HasPendingStatus() { return m_StatusEvents; }
+  void FlushStatus();
 
   static bool InhibidDataUpdates() { return m_inhibidDataUpdates; }
 
@@ -86,6 +123,7 @@ protected:
   void StopChannelStreaming();
 
   bool processRequest(cRequestPacket &req);
+  bool processConcurrentRequest(cRequestPacket &req);
   bool process_Login(cRequestPacket &r);
   bool process_GetTime(cRequestPacket &r);
   bool process_EnableStatusInterface(cRequestPacket &r);
@@ -94,12 +132,14 @@ protected:
   bool process_StoreSetup(cRequestPacket &r);
   bool process_GetSocket(cRequestPacket &r);
   bool process_InvalidateSocket(cRequestPacket &r);
+  bool process_SessionBootstrap(cRequestPacket &r);
 
   bool processChannelStream_Open(cRequestPacket &r);
   bool processChannelStream_Close(cRequestPacket &req);
   bool processChannelStream_Seek(cRequestPacket &r);
   bool processChannelStream_StatusSocket(cRequestPacket &r);
   bool processChannelStream_StatusRequest(cRequestPacket &r);
+  bool processChannelStream_Shm(cRequestPacket &r);
 
   bool processRecStream_Open(cRequestPacket &r);
   bool processRecStream_Close(cRequestPacket &r);
@@ -108,11 +148,15 @@ protected:
   bool processRecStream_FrameNumberFromPosition(cRequestPacket &r);
   bool processRecStream_GetIFrame(cRequestPacket &r);
   bool processRecStream_GetLength(cRequestPacket &r);
+  bool processRecStream_Push(cRequestPacket &r);
+  bool processRecStream_Credit(cRequestPacket &r);
+  bool processRecStream_Seek(cRequestPacket &r);
 
   bool processCHANNELS_GroupsCount(cRequestPacket &r);
   bool processCHANNELS_ChannelsCount(cRequestPacket &r);
   bool processCHANNELS_GroupList(cRequestPacket &r);
   bool processCHANNELS_GetChannels(cRequestPacket &r);
+  bool processCHANNELS_GetChanges(cRequestPacket &r);
   bool processCHANNELS_GetGroupMembers(cRequestPacket &r);
   bool processCHANNELS_GetCaids(cRequestPacket &r);
   bool processCHANNELS_GetWhitelist(cRequestPacket &r);
@@ -125,6 +169,7 @@ protected:
   bool processTIMER_GetCount(cRequestPacket &r);
   bool processTIMER_Get(cRequestPacket &r);
   bool processTIMER_GetList(cRequestPacket &r);
+  bool processTIMER_GetChanges(cRequestPacket &r);
   bool processTIMER_Add(cRequestPacket &r);
   bool processTIMER_Delete(cRequestPacket &r);
   bool processTIMER_Update(cRequestPacket &r);
@@ -133,6 +178,7 @@ protected:
   bool processRECORDINGS_GetDiskSpace(cRequestPacket &r);
   bool processRECORDINGS_GetCount(cRequestPacket &r);
   bool processRECORDINGS_GetList(cRequestPacket &r);
+  bool processRECORDINGS_GetChanges(cRequestPacket &r);
   bool processRECORDINGS_GetInfo(cRequestPacket &r);
   bool processRECORDINGS_Rename(cRequestPacket &r);
   bool processRECORDINGS_Delete(cRequestPacket &r);
@@ -146,6 +192,7 @@ protected:
   bool processRECORDINGS_DELETED_DeleteAll(cRequestPacket &r);
 
   bool processEPG_GetForChannel(cRequestPacket &r);
+  bool processEPG_GetBulk(cRequestPacket &r);
 
   bool processSCAN_ScanSupported(cRequestPacket &r);
   bool processSCAN_GetSupportedTypes(cRequestPacket &r);
@@ -160,7 +207,36 @@ protected:
   bool processOSD_Disconnect();
   bool processOSD_Hitkey(cRequestPacket &req);
 
-  cString CreatePiconRef(const cChannel* channel);
+  /*!
+   * Write the items of a list as in the full list response. If items is
+   * set, the position of each item is recorded for a change journal.
+   */
+  void SerialiseChannels(cResponsePacket &resp, bool radio, bool filter);
+  void SerialiseTimers(cResponsePacket &resp, std::vector<cChangeJournal::sItem> *items);
+  void SerialiseRecordings(cResponsePacket &resp, std::vector<cChangeJournal::sItem> *items);
+  void SerialiseDeletedRecordings(cResponsePacket &resp);
+  uint32_t SerialiseGroupMembers(cResponsePacket &resp, const char *groupname, bool radio, bool filter);
+
+  /*!
+   * Write the groups created before with their members, as in the
+   * bootstrap response
+   */
+  void SerialiseGroups(cResponsePacket &resp, bool automatic, bool filter);
+
+  /*!
+   * Write the changes of a list since a revision, from the journal all
+   * clients share
+   */
+  void WriteChannelChanges(uint32_t since, bool radio, bool filter, cResponsePacket &resp);
+  void WriteTimerChanges(uint32_t since, cResponsePacket &resp);
+  void WriteRecordingChanges(uint32_t since, cResponsePacket &resp);
+  uint64_t ListSource(cChangeJournal::eKind kind);
+
+  /*!
+   * Send a finalised response, compressed if the client supports it
+   * (VNSI_CAP_COMPRESS) and it is large enough to be worth it.
+   */
+  void SendResponse(cResponsePacket &resp);
 
   // Static callback functions to interact with wirbelscan plugin over
   // the plugin service interface
@@ -186,20 +262,74 @@ protected:
   const unsigned int m_Id;
   cxSocket m_socket;
   bool m_loggedIn = false;
+  std::atomic<bool> m_Connected;
+  std::atomic<uint32_t> m_capabilities;     /*!> VNSI_CAP_x enabled at login */
   std::atomic_bool m_StatusInterfaceEnabled;
   cLiveStreamer *m_Streamer = nullptr;
+  std::shared_ptr<cShmRing> m_Ring;         /*!> Stream packets of local clients, if asked for */
+  std::unique_ptr<cPacer> m_Pacer;          /*!> Paces streaming if an uplink rate is set */
+  std::unique_ptr<sStreamStats> m_StreamStats; /*!> Read by GetStats without m_msgLock */
   bool m_isStreaming = false;
   bool m_bSupportRDS = false;
   const cString m_ClientAddress;
   cRecPlayer *m_RecPlayer = nullptr;
-  cCharSetConv m_toUTF8;
+  uint32_t m_RecUID = 0;
+  cRecPusher *m_RecPusher = nullptr;
   uint32_t m_protocolVersion;
+  static const uint32_t MAX_SIZE_HINTS = 256;
+  std::atomic<uint32_t> m_responseSizes[MAX_SIZE_HINTS] = {};  /*!> Last response size by opcode */
+  static const uint32_t COMPRESS_MIN_SIZE = 4096;
+  static const uint32_t CHUNK_SIZE = 256*1024;
+  static const uint32_t SHM_RING_DEFAULT = 16*1024*1024;
+  static const uint32_t SHM_RING_MIN = 1024*1024;
+  static const uint32_t SHM_RING_MAX = 64*1024*1024;
+  std::atomic<uint64_t> m_compressedIn;
+  std::atomic<uint64_t> m_compressedOut;
+  std::atomic<uint64_t> m_compressUsec;      /*!> CPU time spent compressing */
   cMutex m_msgLock;
+
+  /*!
+   * A queued status message, with data or a notification flag. Pushed
+   * onto a lock-free stack, FlushStatus takes all at once and sends them
+   * in the order queued.
+   */
+  struct sStatusEvent
+  {
+    sStatusEvent *next;
+    uint32_t flag;
+    std::string data;
+  };
+  enum
+  {
+    STATUS_TIMERCHANGE       = 0x1,
+    STATUS_CHANNELCHANGE     = 0x2,
+    STATUS_RECORDINGSCHANGE  = 0x4
+  };
+  void QueueStatus(cResponsePacket &resp);
+  void QueueStatusFlag(uint32_t flag);
+  void PushStatus(sStatusEvent *event);
+  void WakeStatus();
+  std::atomic<uint32_t> m_StatusFlags;      /*!> Notifications queued and not yet sent, duplicates coalesce */
+  std::atomic<sStatusEvent*> m_StatusEvents;
+  std::atomic<int> m_StatusCount;
+  cMutex m_FlushMutex;
+  static const int MAX_STATUS_EVENTS = 256;
+  cMutex m_WakeupMutex;
+  std::function<void()> m_StatusWakeup;
   static cMutex m_timerLock;
   cVnsiOsdProvider *m_Osd = nullptr;
   CScanControl m_ChannelScanControl;
   static bool m_inhibidDataUpdates;
 
+  /*!
+   * Take one of limit slots, 0 is no limit. False if all are taken.
+   */
+  static bool AcquireSlot(std::atomic<int> &count, int limit);
+  static std::atomic<int> m_LiveStreams;
+  static std::atomic<int> m_RecordingStreams;
+  bool m_LiveSlot = false;                  /*!> Counted in m_LiveStreams */
+  bool m_RecordingSlot = false;             /*!> Counted in m_RecordingStreams */
+
   typedef struct
   {
     int attempts = 0;
@@ -207,5 +337,6 @@ protected:
     time_t lastTrigger = 0;
   } sEpgUpdate;
   std::map<int, sEpgUpdate> m_epgUpdate;
+  cMutex m_epgLock;                         /*!> Guards m_epgUpdate, also used by concurrent requests */
   CVNSITimers &m_vnsiTimers;
 };
@@ -26,14 +26,28 @@
 #pragma once
 
 /** Current VNSI Protocol Version number */
-#define VNSI_PROTOCOLVERSION 13
+#define VNSI_PROTOCOLVERSION 14
 
 /** Start of RDS support protocol Version */
 #define VNSI_RDS_PROTOCOLVERSION 8
 
+/** Start of compact stream packet headers, VNSI_CHANNEL_STREAM_COMPACT */
+#define VNSI_COMPACT_PROTOCOLVERSION 14
+
 /** Minimum VNSI Protocol Version number */
 #define VNSI_MIN_PROTOCOLVERSION 5
 
+/** Capabilities, the client sends the ones it supports after its name
+ *  on login, the server answers with the ones it enables */
+#define VNSI_CAP_OUTOFORDER           0x00000001  /* responses may arrive out of request order */
+#define VNSI_CAP_RECPUSH              0x00000002  /* recordings can be pushed, VNSI_RECSTREAM_PUSH */
+#define VNSI_CAP_COMPRESS             0x00000004  /* large responses may come zlib compressed */
+#define VNSI_CAP_CHANGES              0x00000008  /* lists can be synced by their changes, _GETCHANGES */
+#define VNSI_CAP_EPGBULK              0x00000010  /* VNSI_EPG_GETBULK */
+#define VNSI_CAP_SHMSTREAM            0x00000020  /* VNSI_CHANNELSTREAM_SHM, unix domain sockets only */
+#define VNSI_CAP_MUXBATCH             0x00000040  /* mux packets may come in VNSI_STREAM_MUXPKT_BATCH */
+#define VNSI_CAP_BOOTSTRAP            0x00000080  /* VNSI_SESSION_BOOTSTRAP */
+
 /** Packet types */
 #define VNSI_CHANNEL_REQUEST_RESPONSE 1
 #define VNSI_CHANNEL_STREAM           2
@@ -42,6 +56,19 @@
 #define VNSI_CHANNEL_STATUS           5
 #define VNSI_CHANNEL_SCAN             6
 #define VNSI_CHANNEL_OSD              7
+#define VNSI_CHANNEL_RECSTREAM        8
+#define VNSI_CHANNEL_COMPRESSED       9  /* response, 4 bytes uncompressed length before the zlib data */
+#define VNSI_CHANNEL_STREAM_COMPACT   10 /* VNSI_STREAM_MUXPKT with a variable length header */
+
+/** Header of VNSI_CHANNEL_STREAM_COMPACT, following the channel:
+ *  U8 flags, then unsigned LEB128 varints: the stream ID minus the one of
+ *  the previous packet and the PTS minus the previous PTS of this stream,
+ *  both zigzag encoded; if flagged the zigzag DTS minus PTS, the duration
+ *  and the serial; last the payload length. Previous values start at 0
+ *  and are reset by each VNSI_STREAM_CHANGE. */
+#define VNSI_COMPACT_DTS              0x01  /* DTS differs from PTS */
+#define VNSI_COMPACT_DURATION         0x02  /* duration is not 0 */
+#define VNSI_COMPACT_SERIAL           0x04  /* serial differs from the previous packet */
 
 /** Response packets operation codes */
 
@@ -66,6 +93,17 @@
 #define VNSI_STORESETUP            9
 #define VNSI_GETSOCKET            10
 #define VNSI_INVALIDATESOCKET     11
+#define VNSI_SESSION_BOOTSTRAP    12  /* several responses, each ends with section 0 and a U32 more flag */
+
+/** Sections of VNSI_SESSION_BOOTSTRAP, each answered as U32 section,
+ *  U32 length and the data. Channels, timers and recordings are written
+ *  like their _GETCHANGES responses, since the revision in the request. */
+#define VNSI_BOOTSTRAP_CHANNELS_TV    0x01
+#define VNSI_BOOTSTRAP_CHANNELS_RADIO 0x02
+#define VNSI_BOOTSTRAP_GROUPS         0x04  /* per TV and radio the groups, each with its members */
+#define VNSI_BOOTSTRAP_TIMERS         0x08
+#define VNSI_BOOTSTRAP_RECORDINGS     0x10
+#define VNSI_BOOTSTRAP_DELETED        0x20  /* as VNSI_RECORDINGS_DELETED_GETLIST */
 
 /* OPCODE 20 - 39: VNSI network functions for live streaming */
 #define VNSI_CHANNELSTREAM_OPEN     20
@@ -73,6 +111,7 @@
 #define VNSI_CHANNELSTREAM_SEEK     22
 #define VNSI_CHANNELSTREAM_STATUS_SOCKET  23
 #define VNSI_CHANNELSTREAM_STATUS_REQUEST 24
+#define VNSI_CHANNELSTREAM_SHM      25  /* stream packets of later opened streams go to a shared ring */
 
 /* OPCODE 40 - 59: VNSI network functions for recording streaming */
 #define VNSI_RECSTREAM_OPEN        40
@@ -82,6 +121,9 @@
 #define VNSI_RECSTREAM_FRAMETOPOS  44
 #define VNSI_RECSTREAM_GETIFRAME   45
 #define VNSI_RECSTREAM_GETLENGTH   46
+#define VNSI_RECSTREAM_PUSH        47  /* start pushing blocks, answers the serial */
+#define VNSI_RECSTREAM_CREDIT      48  /* grant more bytes to push, not answered */
+#define VNSI_RECSTREAM_SEEK        49  /* flush and push from a new position, answers the serial */
 
 /* OPCODE 60 - 79: VNSI network functions for channel access */
 #define VNSI_CHANNELS_GETCOUNT     61
@@ -94,6 +136,7 @@
 #define VNSI_CHANNELS_GETBLACKLIST 70
 #define VNSI_CHANNELS_SETWHITELIST 71
 #define VNSI_CHANNELS_SETBLACKLIST 72
+#define VNSI_CHANNELS_GETCHANGES   73
 
 /* OPCODE 80 - 99: VNSI network functions for timer access */
 #define VNSI_TIMER_GETCOUNT        80
@@ -103,6 +146,7 @@
 #define VNSI_TIMER_DELETE          84
 #define VNSI_TIMER_UPDATE          85
 #define VNSI_TIMER_GETTYPES        86
+#define VNSI_TIMER_GETCHANGES      87
 
 /* OPCODE 100 - 119: VNSI network functions for recording access */
 #define VNSI_RECORDINGS_DISKSIZE   100
@@ -111,9 +155,11 @@
 #define VNSI_RECORDINGS_RENAME     103
 #define VNSI_RECORDINGS_DELETE     104
 #define VNSI_RECORDINGS_GETEDL     105
+#define VNSI_RECORDINGS_GETCHANGES 106
 
 /* OPCODE 120 - 139: VNSI network functions for epg access and manipulating */
 #define VNSI_EPG_GETFORCHANNEL     120
+#define VNSI_EPG_GETBULK           121  /* several responses, each ends with UID 0 and a U32 more flag */
 
 /* OPCODE 140 - 159: VNSI network functions for channel scanning */
 #define VNSI_SCAN_SUPPORTED        140
@@ -146,6 +192,7 @@
 #define VNSI_STREAM_BUFFERSTATS  7
 #define VNSI_STREAM_REFTIME      8
 #define VNSI_STREAM_TIMES        9
+#define VNSI_STREAM_MUXPKT_BATCH 10  /* stream ID is the packet count, the payload the packets in order */
 
 /** Scan packet types (server -> client) */
 #define VNSI_SCANNER_PERCENTAGE  1
@@ -190,6 +237,7 @@
 /** Packet return codes */
 #define VNSI_RET_OK              0
 #define VNSI_RET_RECRUNNING      1
+#define VNSI_RET_SERVERBUSY      994  /* an admission limit of the server is reached */
 #define VNSI_RET_NOTSUPPORTED    995
 #define VNSI_RET_DATAUNKNOWN     996
 #define VNSI_RET_DATALOCKED      997
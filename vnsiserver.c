@@ -27,6 +27,8 @@
 #include "vnsiclient.h"
 #include "vnsi.h"
 #include "channelfilter.h"
+#include "responsepacket.h"
+#include "vnsicommand.h"
 
 #include <netdb.h>
 #include <poll.h>
@@ -42,23 +44,57 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 
 #include <vdr/plugin.h>
 
 unsigned int cVNSIServer::m_IdCnt = 0;
 
+/*!
+ * The address/mask entries of the allowed hosts file, parsed once and
+ * reloaded only when the modification time of the file or its fallback
+ * changes.
+ */
 class cAllowedHosts : public cSVDRPhosts
 {
 public:
   cAllowedHosts(const cString& AllowedHostsFile)
+   : m_AllowedHostsFile(AllowedHostsFile)
+   , m_FallbackFile(cString::sprintf("%s/../svdrphosts.conf", *VNSIServerConfig.ConfigDirectory))
   {
-    if (!Load(AllowedHostsFile, true, true))
+  }
+
+  bool Acceptable(in_addr_t Address)
+  {
+    time_t mtime = ModificationTime(m_AllowedHostsFile);
+    time_t fallbackMtime = ModificationTime(m_FallbackFile);
+    if (!m_Loaded || mtime != m_Mtime || fallbackMtime != m_FallbackMtime)
     {
-      ERRORLOG("Invalid or missing '%s'. falling back to 'svdrphosts.conf'.", *AllowedHostsFile);
-      cString Base = cString::sprintf("%s/../svdrphosts.conf", *VNSIServerConfig.ConfigDirectory);
-      if (!Load(Base, true, true))
+      Reload();
+      m_Loaded = true;
+      m_Mtime = mtime;
+      m_FallbackMtime = fallbackMtime;
+    }
+    return cSVDRPhosts::Acceptable(Address);
+  }
+
+protected:
+  static time_t ModificationTime(const char *FileName)
+  {
+    struct stat st;
+    if (stat(FileName, &st) < 0)
+      return 0;
+    return st.st_mtime;
+  }
+
+  void Reload()
+  {
+    if (!Load(m_AllowedHostsFile, true, true))
+    {
+      ERRORLOG("Invalid or missing '%s'. falling back to 'svdrphosts.conf'.", *m_AllowedHostsFile);
+      if (!Load(m_FallbackFile, true, true))
       {
-        ERRORLOG("Invalid or missing %s. Adding 127.0.0.1 to list of allowed hosts.", *Base);
+        ERRORLOG("Invalid or missing %s. Adding 127.0.0.1 to list of allowed hosts.", *m_FallbackFile);
         cSVDRPhost *localhost = new cSVDRPhost;
         if (localhost->Parse("127.0.0.1"))
           Add(localhost);
@@ -67,6 +103,12 @@ public:
       }
     }
   }
+
+  cString m_AllowedHostsFile;
+  cString m_FallbackFile;
+  bool m_Loaded = false;
+  time_t m_Mtime = 0;
+  time_t m_FallbackMtime = 0;
 };
 
 cVNSIServer::cVNSIServer(int listenPort) : cThread("VNSI Server")
@@ -83,28 +125,62 @@ cVNSIServer::cVNSIServer(int listenPort) : cThread("VNSI Server")
 cVNSIServer::~cVNSIServer()
 {
   Cancel();
+#ifdef __linux__
+  m_Reactor.Close();
+#endif
   m_Status.Shutdown();
   m_timers.Shutdown();
+  delete m_AllowedHosts;
+  if (m_UnixFD >= 0)
+  {
+    close(m_UnixFD);
+    unlink(VNSIServerConfig.socket_path);
+  }
   INFOLOG("VNSI Server stopped");
 }
 
-void cVNSIServer::NewClientConnected(int fd)
+void cVNSIServer::NewClientConnected(int fd, bool local)
 {
   char buf[64];
   struct sockaddr_in sin;
   socklen_t len = sizeof(sin);
 
-  if (getpeername(fd, (struct sockaddr *)&sin, &len))
+  // local clients are only limited by the permissions of the socket
+  if (local)
+    strcpy(buf, "local");
+  else
   {
-    ERRORLOG("getpeername() failed, dropping new incoming connection %d", m_IdCnt);
-    close(fd);
-    return;
+    if (getpeername(fd, (struct sockaddr *)&sin, &len))
+    {
+      ERRORLOG("getpeername() failed, dropping new incoming connection %d", m_IdCnt);
+      close(fd);
+      return;
+    }
+
+    if (!m_AllowedHosts)
+      m_AllowedHosts = new cAllowedHosts(m_AllowedHostsFile);
+    if (!m_AllowedHosts->Acceptable(sin.sin_addr.s_addr))
+    {
+      ERRORLOG("Address not allowed to connect (%s)", *m_AllowedHostsFile);
+      close(fd);
+      return;
+    }
+
+    cxSocket::ip2txt(sin.sin_addr.s_addr, sin.sin_port, buf);
   }
 
-  cAllowedHosts AllowedHosts(m_AllowedHostsFile);
-  if (!AllowedHosts.Acceptable(sin.sin_addr.s_addr))
+  // refused before a client and its threads exist, the message is shown
+  // by the client
+  if (VNSIServerConfig.max_clients > 0 && m_Status.GetClientCount() >= VNSIServerConfig.max_clients)
   {
-    ERRORLOG("Address not allowed to connect (%s)", *m_AllowedHostsFile);
+    ERRORLOG("Too many clients (%d), dropping new incoming connection %s", VNSIServerConfig.max_clients, buf);
+    cResponsePacket resp;
+    resp.initStatus(VNSI_STATUS_MESSAGE);
+    resp.add_U32(0);
+    resp.add_String("VNSI server busy, too many clients connected");
+    resp.finalise();
+    if (::write(fd, resp.getPtr(), resp.getLen()) < 0)
+      DEBUGLOG("Could not tell the dropped connection");
     close(fd);
     return;
   }
@@ -116,32 +192,48 @@ void cVNSIServer::NewClientConnected(int fd)
     return;
   }
 
-  int val = 1;
-  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
+  if (!local)
+  {
+    int val = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
 
 #ifdef SOL_TCP
-  val = 30;
-  setsockopt(fd, SOL_TCP, TCP_KEEPIDLE, &val, sizeof(val));
+    val = 30;
+    setsockopt(fd, SOL_TCP, TCP_KEEPIDLE, &val, sizeof(val));
 
-  val = 15;
-  setsockopt(fd, SOL_TCP, TCP_KEEPINTVL, &val, sizeof(val));
+    val = 15;
+    setsockopt(fd, SOL_TCP, TCP_KEEPINTVL, &val, sizeof(val));
 
-  val = 5;
-  setsockopt(fd, SOL_TCP, TCP_KEEPCNT, &val, sizeof(val));
+    val = 5;
+    setsockopt(fd, SOL_TCP, TCP_KEEPCNT, &val, sizeof(val));
 
-  val = 1;
-  setsockopt(fd, SOL_TCP, TCP_NODELAY, &val, sizeof(val));
+    val = 1;
+    setsockopt(fd, SOL_TCP, TCP_NODELAY, &val, sizeof(val));
 #endif
+  }
 
-  INFOLOG("Client with ID %d connected: %s", m_IdCnt, cxSocket::ip2txt(sin.sin_addr.s_addr, sin.sin_port, buf));
-  m_Status.AddClient(fd, m_IdCnt, cxSocket::ip2txt(sin.sin_addr.s_addr, sin.sin_port, buf), m_timers);
+  INFOLOG("Client with ID %d connected: %s", m_IdCnt, buf);
+  std::shared_ptr<cVNSIClient> client = m_Status.AddClient(fd, m_IdCnt, buf, m_timers);
   m_IdCnt++;
+
+#ifdef __linux__
+  if (!m_Reactor.AddClient(client, fd))
+    client->Disconnected();
+  else
+  {
+    cVNSIReactor *reactor = &m_Reactor;
+    cVNSIClient *c = client.get();
+    client->SetStatusWakeup([reactor, c, fd]() { reactor->WakeClient(c, fd); });
+  }
+#endif
 }
 
 void cVNSIServer::Action(void)
 {
+#ifndef __linux__
   fd_set fds;
   struct timeval tv;
+#endif
 
   if(*VNSIServerConfig.ConfigDirectory)
   {
@@ -184,15 +276,44 @@ void cVNSIServer::Action(void)
 
   listen(m_ServerFD, 10);
 
+  if (*VNSIServerConfig.socket_path && !OpenUnixSocket())
+    ERRORLOG("Unable to listen on %s", *VNSIServerConfig.socket_path);
+
+#ifdef __linux__
+  fcntl(m_ServerFD, F_SETFL, fcntl(m_ServerFD, F_GETFL) | O_NONBLOCK);
+  if (!m_Reactor.Open(m_ServerFD))
+  {
+    close(m_ServerFD);
+    m_ServerFD = -1;
+    return;
+  }
+  if (m_UnixFD >= 0)
+  {
+    fcntl(m_UnixFD, F_SETFL, fcntl(m_UnixFD, F_GETFL) | O_NONBLOCK);
+    m_Reactor.AddListener(m_UnixFD);
+  }
+
+  while (Running())
+  {
+    if (!m_Reactor.Poll(250))
+      continue;
+
+    AcceptClients(m_ServerFD, false);
+    if (m_UnixFD >= 0)
+      AcceptClients(m_UnixFD, true);
+  }
+#else
   while (Running())
   {
     FD_ZERO(&fds);
     FD_SET(m_ServerFD, &fds);
+    if (m_UnixFD >= 0)
+      FD_SET(m_UnixFD, &fds);
 
     tv.tv_sec = 0;
     tv.tv_usec = 250*1000;
 
-    int r = select(m_ServerFD + 1, &fds, NULL, NULL, &tv);
+    int r = select((m_ServerFD > m_UnixFD ? m_ServerFD : m_UnixFD) + 1, &fds, NULL, NULL, &tv);
     if (r == -1)
     {
       ERRORLOG("failed during select");
@@ -203,15 +324,86 @@ void cVNSIServer::Action(void)
       continue;
     }
 
-    int fd = accept(m_ServerFD, 0, 0);
-    if (fd >= 0)
+    if (FD_ISSET(m_ServerFD, &fds))
+      AcceptClients(m_ServerFD, false);
+    if (m_UnixFD >= 0 && FD_ISSET(m_UnixFD, &fds))
+      AcceptClients(m_UnixFD, true);
+  }
+#endif
+  return;
+}
+
+bool cVNSIServer::OpenUnixSocket()
+{
+  struct sockaddr_un s;
+  memset(&s, 0, sizeof(s));
+  s.sun_family = AF_UNIX;
+  if (strlen(VNSIServerConfig.socket_path) >= sizeof(s.sun_path))
+    return false;
+  strcpy(s.sun_path, VNSIServerConfig.socket_path);
+
+  m_UnixFD = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_UnixFD == -1)
+    return false;
+
+  fcntl(m_UnixFD, F_SETFD, fcntl(m_UnixFD, F_GETFD) | FD_CLOEXEC);
+
+  // left behind by a previous run, anything but a socket is not ours
+  struct stat st;
+  if (lstat(s.sun_path, &st) == 0)
+  {
+    if (!S_ISSOCK(st.st_mode))
     {
-      NewClientConnected(fd);
+      ERRORLOG("%s exists and is not a socket", s.sun_path);
+      close(m_UnixFD);
+      m_UnixFD = -1;
+      return false;
     }
-    else
+    unlink(s.sun_path);
+  }
+
+  // nobody may connect before the mode is set
+  mode_t mask = umask(077);
+  int ret = bind(m_UnixFD, (struct sockaddr *)&s, sizeof(s));
+  umask(mask);
+
+  if (ret < 0 ||
+      chmod(s.sun_path, VNSIServerConfig.socket_mode) < 0 ||
+      listen(m_UnixFD, 10) < 0)
+  {
+    close(m_UnixFD);
+    m_UnixFD = -1;
+    return false;
+  }
+
+  INFOLOG("VNSI Server listening on %s", s.sun_path);
+  return true;
+}
+
+void cVNSIServer::AcceptClients(int listenFd, bool local)
+{
+#ifdef __linux__
+  // edge-triggered, accept until the backlog is empty
+  for (;;)
+  {
+    int fd = accept(listenFd, 0, 0);
+    if (fd < 0)
     {
-      ERRORLOG("accept failed");
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        ERRORLOG("accept failed");
+      break;
     }
+    NewClientConnected(fd, local);
   }
-  return;
+#else
+  int fd = accept(listenFd, 0, 0);
+  if (fd >= 0)
+  {
+    NewClientConnected(fd, local);
+  }
+  else
+  {
+    ERRORLOG("accept failed");
+  }
+#endif
 }
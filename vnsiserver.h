@@ -31,27 +31,38 @@
 #include "config.h"
 #include "status.h"
 #include "vnsitimer.h"
+#include "reactor.h"
 
 class cVNSIClient;
+class cAllowedHosts;
 
 class cVNSIServer : public cThread
 {
 protected:
 
   virtual void Action(void);
-  void NewClientConnected(int fd);
+  bool OpenUnixSocket();
+  void AcceptClients(int listenFd, bool local);
+  void NewClientConnected(int fd, bool local);
 
   int m_ServerPort;
   int m_ServerFD;
+  int m_UnixFD = -1;                             /*!> Listener for clients on this host */
   cString m_AllowedHostsFile;
+  cAllowedHosts *m_AllowedHosts = nullptr;      /*!> Loaded on the first connection */
   CVNSITimers m_timers;
   cVNSIStatus m_Status;
+#ifdef __linux__
+  cVNSIReactor m_Reactor;
+#endif
 
   static unsigned int m_IdCnt;
 
 public:
   cVNSIServer(int listenPort);
   virtual ~cVNSIServer();
+
+  cString GetStats() { return m_Status.GetStats(); }
 };
 
 #endif // VNSI_SERVER_H